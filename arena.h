@@ -0,0 +1,117 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace data {
+
+    /** A bump allocator for objects of a single type.
+     * Objects are constructed one after another in large blocks, so creating one is usually just a pointer bump,
+     * and they are all destroyed and freed together by clear (or when the arena is destroyed).
+     * Objects never move, so pointers to them stay valid until then. Objects cannot be freed one at a time.
+     */
+    template <typename T>
+    class Arena {
+        public:
+            Arena() = default;
+            Arena(const Arena &other) = delete;
+            Arena &operator=(const Arena &other) = delete;
+
+            Arena(Arena &&other) noexcept { swap(other); }
+
+            Arena &operator=(Arena &&other) noexcept {
+                if (this != &other) {
+                    clear();
+                    swap(other);
+                }
+
+                return *this;
+            }
+
+            ~Arena() { clear(); }
+
+            // Construct a new object at the end of the current block, starting a new block if it is full.
+            template <typename... Args>
+            T *create(Args&&... args) {
+                if (blocks.empty() || blocks.back().used == blocks.back().capacity) grow();
+
+                Block &block = blocks.back();
+                T *object = new (block.data() + block.used) T(std::forward<Args>(args)...);
+                block.used++;
+                count++;
+
+                return object;
+            }
+
+            // Destroy every object and free every block.
+            void clear() {
+                for (Block &block : blocks) {
+                    for (size_t i = 0; i < block.used; i++) block.data()[i].~T();
+                }
+
+                blocks.clear();
+                count = 0;
+            }
+
+            // Take over every object in other, which is left empty. Pointers to its objects stay valid.
+            void splice(Arena &other) {
+                if (this == &other) return;
+
+                // keep the block being filled last, so its spare room is used first
+                auto last = blocks.empty() ? blocks.end() : blocks.end() - 1;
+                blocks.insert(last, std::make_move_iterator(other.blocks.begin()), std::make_move_iterator(other.blocks.end()));
+
+                count += other.count;
+                other.blocks.clear();
+                other.count = 0;
+            }
+
+            // Returns true if object was created by this arena (and has not been cleared since).
+            bool owns(const T *object) const {
+                return std::any_of(blocks.begin(), blocks.end(), [object](const Block &block) {
+                    return std::less_equal<const T*>()(block.data(), object) && std::less<const T*>()(object, block.data() + block.used);
+                });
+            }
+
+            void swap(Arena &other) noexcept {
+                blocks.swap(other.blocks);
+                std::swap(count, other.count);
+            }
+
+            // The number of objects in the arena.
+            size_t size() const { return count; }
+
+            // The number of blocks the arena has allocated, each a single heap allocation.
+            size_t allocations() const { return blocks.size(); }
+
+        private:
+            // Uninitialized room for capacity objects, of which the first used have been constructed.
+            struct Block {
+                std::unique_ptr<typename std::aligned_storage<sizeof(T), alignof(T)>::type[]> storage;
+                size_t capacity = 0;
+                size_t used = 0;
+
+                T *data() const { return reinterpret_cast<T*>(storage.get()); }
+            };
+
+            // Blocks double in size, from FIRST_BLOCK up to LAST_BLOCK objects.
+            static constexpr size_t FIRST_BLOCK = 64;
+            static constexpr size_t LAST_BLOCK = 65536;
+
+            void grow() {
+                Block block;
+                block.capacity = blocks.empty() ? FIRST_BLOCK : std::min(LAST_BLOCK, 2 * blocks.back().capacity);
+                block.storage.reset(new typename std::aligned_storage<sizeof(T), alignof(T)>::type[block.capacity]);
+
+                blocks.push_back(std::move(block));
+            }
+
+            std::vector<Block> blocks;
+            size_t count = 0;
+    };
+
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace data {
+
+    /** An airline, stored as its index in a dictionary of carrier codes shared by every loader and graph in the program.
+     * Creating a Carrier from a code looks the code up (adding it the first time it is seen). After that, carriers
+     * compare, hash and copy as small integers. The empty code is index 0, which default-constructed carriers use.
+     * The dictionary is safe to use from several threads. It holds at most 65536 codes.
+     */
+    class Carrier {
+        public:
+            Carrier() = default;
+            Carrier(std::string_view code) : index(intern(code)) {}
+            Carrier(const std::string &code) : Carrier(std::string_view(code)) {}
+            Carrier(const char *code) : Carrier(std::string_view(code)) {}
+
+            /** Look up a code without adding it to the dictionary.
+             * @return false if the code has never been used
+             */
+            static bool find(std::string_view code, Carrier &found) {
+                Table &t = table();
+                std::lock_guard<std::mutex> guard(t.lock);
+
+                auto i = t.index.find(code);
+                if (i == t.index.end()) return false;
+
+                found.index = i->second;
+                return true;
+            }
+
+            /** The carrier with an index from id().
+             * @throws -1 if no carrier has that index
+             */
+            static Carrier fromId(uint16_t id) {
+                if (id >= count()) throw -1;
+
+                Carrier c;
+                c.index = id;
+                return c;
+            }
+
+            // The number of codes in the dictionary, including the empty code.
+            static size_t count() {
+                Table &t = table();
+                std::lock_guard<std::mutex> guard(t.lock);
+
+                return t.codes.size();
+            }
+
+            uint16_t id() const { return index; }
+
+            const std::string &code() const {
+                Table &t = table();
+                std::lock_guard<std::mutex> guard(t.lock);
+
+                // codes never move, so the reference outlives the lock
+                return t.codes[index];
+            }
+
+            bool operator==(const Carrier &other) const { return index == other.index; }
+            bool operator!=(const Carrier &other) const { return index != other.index; }
+
+            // Orders carriers by index (the order they were first seen), not by code.
+            bool operator<(const Carrier &other) const { return index < other.index; }
+
+        private:
+            // Codes by index, and the index of each code. The keys view the codes, which a deque never moves.
+            struct Table {
+                std::mutex lock;
+                std::deque<std::string> codes;
+                std::unordered_map<std::string_view, uint16_t> index;
+
+                Table() {
+                    codes.push_back("");
+                    index[codes.back()] = 0;
+                }
+            };
+
+            static Table &table() {
+                static Table t;
+                return t;
+            }
+
+            // Returns the index of a code, adding it if it is new. Throws -1 if the dictionary is full.
+            static uint16_t intern(std::string_view code) {
+                Table &t = table();
+                std::lock_guard<std::mutex> guard(t.lock);
+
+                auto i = t.index.find(code);
+                if (i != t.index.end()) return i->second;
+
+                if (t.codes.size() > UINT16_MAX) throw -1;
+
+                t.codes.push_back(std::string(code));
+                return t.index[t.codes.back()] = t.codes.size() - 1;
+            }
+
+            uint16_t index = 0;
+    };
+
+    inline std::ostream &operator<<(std::ostream &out, const Carrier &c) {
+        return out << c.code();
+    }
+
+}
+
+namespace std {
+    template <>
+    struct hash<data::Carrier> {
+        size_t operator()(const data::Carrier &c) const { return c.id(); }
+    };
+}
@@ -2,9 +2,11 @@
 #include "utils.h"
 
 #include <algorithm>
-#include <set>
+#include <cmath>
 #include <map>
 #include <queue>
+#include <thread>
+#include <utility>
 
 using data::Airport;
 using data::Flight;
@@ -12,9 +14,47 @@ using data::Graph;
 
 // Graph class implementation goes here
 
+namespace {
+    const int CODE_TABLE_SIZE = 26 * 26 * 26;
+
+    // The slot of a three-letter airport code in Graph::code_table, or -1 if it is not three capital letters.
+    int codeSlot(const std::string &code) {
+        if (code.size() != 3) return -1;
+
+        int slot = 0;
+
+        for (char c : code) {
+            if (c < 'A' || c > 'Z') return -1;
+            slot = slot * 26 + (c - 'A');
+        }
+
+        return slot;
+    }
+
+    // How many times a flight runs in a month, used to weight routes when ranking.
+    size_t monthlyCount(data::Frequency frequency) {
+        switch (frequency) {
+            case data::DAILY:
+                return 7 * 4;
+            case data::WEEKLY:
+                return 4;
+            case data::MONTHLY:
+                return 1;
+        }
+
+        return 0;
+    }
+
+    // Add an airport to a list sorted by airport_id, unless it is already there.
+    void insertSorted(std::vector<Airport*> &airports, Airport *a) {
+        auto i = std::lower_bound(airports.begin(), airports.end(), a, data::AirportIdLess());
+        if (i == airports.end() || (*i)->airport_id != a->airport_id) airports.insert(i, a);
+    }
+}
+
 Graph::Graph() {
     vertexList = std::unordered_map<size_t, IncidentEdgeList>();
-    edgeList = std::unordered_map<size_t, EdgeListNode>();
+    edgeList = std::unordered_map<size_t, Flight*>();
 }
 
 Graph::Graph(const Graph &other) {
@@ -30,22 +70,82 @@ Graph &Graph::operator=(const Graph &other) {
     return *this;
 }
 
+Graph::Graph(Graph &&other) noexcept {
+    swap(other);
+}
+
+Graph &Graph::operator=(Graph &&other) noexcept {
+    if (this != &other) {
+        // the old contents are freed with moved
+        Graph moved(std::move(other));
+        swap(moved);
+    }
+
+    return *this;
+}
+
 Graph::~Graph() {
     clear();
 }
 
+void Graph::swap(Graph &other) noexcept {
+    vertexList.swap(other.vertexList);
+    edgeList.swap(other.edgeList);
+
+    airport_arena.swap(other.airport_arena);
+    flight_arena.swap(other.flight_arena);
+
+    code_table.swap(other.code_table);
+    other_codes.swap(other.other_codes);
+
+    std::swap(frozen, other.frozen);
+    std::swap(is_frozen, other.is_frozen);
+    stop_table.swap(other.stop_table);
+    carrier_flights.swap(other.carrier_flights);
+
+    std::swap(tracked_rank, other.tracked_rank);
+    std::swap(is_tracking, other.is_tracking);
+
+    rank_airports.swap(other.rank_airports);
+    rank_state.swap(other.rank_state);
+}
+
 void Graph::copy(const Graph &other) {
+    is_frozen = false;
+    frozen = FrozenGraph();
+
+    rank_airports.clear();
+    rank_state.clear();
+
+    is_tracking = false;
+    tracked_rank = IncrementalRank();
+
+    // operator= has freed the old airports already, drop everything that points at them
+    vertexList.clear();
+    edgeList.clear();
+    flight_arena.clear();
+    stop_table.clear();
+
+    code_table.clear();
+    other_codes.clear();
+
+    carrier_flights.clear();
+
     std::vector<Airport*> airports = other.getAirports();
     std::vector<Flight> flights = other.getFlights();
 
     for (Airport *a : airports) {
-        Airport *add = new Airport(*a);
+        Airport *add = airport_arena.create(*a);
         createVertex(add);
     }
 
+    // createEdge adds to the front of each list, so add a frozen graph's flights backwards to keep its order
+    if (other.is_frozen) std::reverse(flights.begin(), flights.end());
+
+    // point the flights at this graph's copies of their airports
     for (Flight f: flights) {
-        Airport *start = other.getVertex(f.departure->airport_id);
-        Airport *end = other.getVertex(f.arrival->airport_id);
+        Airport *start = getVertex(f.departure->airport_id);
+        Airport *end = getVertex(f.arrival->airport_id);
 
         Flight add = f;
         add.departure = start;
@@ -53,14 +153,22 @@ void Graph::copy(const Graph &other) {
 
         createEdge(add);
     }
+
+    if (other.is_frozen) freeze();
+
+    // the airports are in the same order, so the table still fits
+    stop_table = other.stop_table;
 }
 
 void Graph::clear() {
     std::vector<Airport*> airports = getAirports();
 
+    // airports in the arena are freed all at once
     for (Airport *a : airports) {
-        delete a;
+        if (!airport_arena.owns(a)) delete a;
     }
+
+    airport_arena.clear();
 }
 
 Airport *Graph::getVertex(size_t id) const {
@@ -68,15 +176,46 @@ Airport *Graph::getVertex(size_t id) const {
 }
 
 Airport *Graph::getVertex(std::string code) const {
-    for (auto i = vertexList.begin(); i != vertexList.end(); i++) {
-        if (i -> second.airport->airport_code == code) return i->second.airport;
+    int slot = codeSlot(code);
+    Airport *found = NULL;
+
+    if (slot >= 0) {
+        if (!code_table.empty()) found = code_table[slot];
+    } else {
+        auto i = other_codes.find(code);
+        if (i != other_codes.end()) found = i->second;
     }
 
-    throw -1;
+    if (found == NULL) throw -1;
+
+    return found;
+}
+
+std::vector<Airport*> Graph::getVertices(const std::vector<std::string> &codes) const {
+    std::vector<Airport*> airports;
+    airports.reserve(codes.size());
+
+    for (const std::string &code : codes) {
+        int slot = codeSlot(code);
+
+        if (slot >= 0) {
+            airports.push_back(code_table.empty() ? NULL : code_table[slot]);
+        } else {
+            auto i = other_codes.find(code);
+            airports.push_back(i == other_codes.end() ? NULL : i->second);
+        }
+    }
+
+    return airports;
 }
 
 Flight Graph::getEdge(size_t id) const {
-    return edgeList.find(id) -> second.flight;
+    if (is_frozen) {
+        auto found = std::lower_bound(frozen.flight_ids.begin(), frozen.flight_ids.end(), std::pair<size_t, uint32_t>(id, 0));
+        return frozen.flight(found->second);
+    }
+
+    return *edgeList.find(id) -> second;
 }
 
 std::vector<Airport*> Graph::getAirports() const {
@@ -91,158 +230,290 @@ std::vector<Airport*> Graph::getAirports() const {
 std::vector<Flight> Graph::getFlights() const {
     std::vector<Flight> flights;
 
+    if (is_frozen) {
+        for (uint32_t k = 0; k < frozen.flights.size(); k++) flights.push_back(frozen.flight(k));
+        return flights;
+    }
+
     for (auto i = edgeList.begin(); i != edgeList.end(); i++) {
-        flights.push_back(i->second.flight);
+        flights.push_back(*i->second);
     }    
 
     return flights;
 }
 
 void Graph::createVertex(Airport* a) {
+    if (is_frozen) thaw();
+
     vertexList[a->airport_id].airport = a;
+
+    int slot = codeSlot(a->airport_code);
+
+    if (slot >= 0) {
+        if (code_table.empty()) code_table.assign(CODE_TABLE_SIZE, NULL);
+        code_table[slot] = a;
+    } else {
+        other_codes[a->airport_code] = a;
+    }
+
+    if (is_tracking && tracked_rank.index.count(a->airport_id) == 0) trackRanking(tracked_rank.damping, tracked_rank.threads);
+}
+
+Airport *Graph::createVertex(size_t id, const std::string &code) {
+    Airport *a = airport_arena.create();
+    a->airport_id = id;
+    a->airport_code = code;
+
+    createVertex(a);
+    return a;
+}
+
+void Graph::adoptAirports(Arena<Airport> &airports) {
+    airport_arena.splice(airports);
 }
 
 void Graph::createEdge(Flight& f) {
+    if (is_frozen) thaw();
 
-    vertexList[f.arrival->airport_id].arriving.push_front(f);
-    vertexList[f.departure->airport_id].departing.push_front(f);
+    Flight *stored = flight_arena.create(f);
 
-    edgeList[f.flight_id] = EdgeListNode(f);
+    IncidentEdgeList &to = vertexList[f.arrival->airport_id];
+    IncidentEdgeList &from = vertexList[f.departure->airport_id];
 
-}
+    to.arriving.push_front(stored);
+    from.departing.push_front(stored);
 
-bool Graph::areAdjacent(Airport* first, Airport* second) const {
-    if (first == NULL || second == NULL) return false;
+    insertSorted(to.origins, f.departure);
+    insertSorted(from.destinations, f.arrival);
+
+    edgeList[f.flight_id] = stored;
+
+    if (carrier_flights.size() <= f.airline.id()) carrier_flights.resize(f.airline.id() + 1, 0);
+    carrier_flights[f.airline.id()]++;
 
-    std::vector<Airport*> inc_first = outgoingNodes(first);
-    std::vector<Airport*> inc_second = outgoingNodes(second);
+    if (is_tracking) {
+        auto from = tracked_rank.index.find(f.departure->airport_id);
+        auto to = tracked_rank.index.find(f.arrival->airport_id);
 
-    for (Airport *a : inc_second) {
-        if (a-> airport_id == first-> airport_id) return true;
+        if (from == tracked_rank.index.end() || to == tracked_rank.index.end()) trackRanking(tracked_rank.damping, tracked_rank.threads);
+        else tracked_rank.addFlight(from->second, to->second, monthlyCount(f.frequency));
     }
+}
+
+void Graph::freeze() {
+    if (is_frozen) return;
+
+    frozen = FrozenGraph(vertexList);
+    is_frozen = true;
 
-    for (Airport *a : inc_first) {
-        if (a-> airport_id == second-> airport_id) return true;
+    // the frozen graph holds every flight now, keep only the airports
+    for (auto i = vertexList.begin(); i != vertexList.end(); i++) {
+        i->second.departing = std::deque<Flight*>();
+        i->second.arriving = std::deque<Flight*>();
+        i->second.destinations = std::vector<Airport*>();
+        i->second.origins = std::vector<Airport*>();
     }
 
-    return false;
+    edgeList = std::unordered_map<size_t, Flight*>();
+    flight_arena.clear();
 }
 
-std::vector<Airport*> Graph::incomingNodes(Airport* arrival) const {
-    IncidentEdgeList incidentEdgeList = vertexList.at(arrival->airport_id);
-    std::list<Flight> arriving = incidentEdgeList.arriving;
-
-    std::set<Airport*> result;
+void Graph::thaw() {
+    is_frozen = false;
+    stop_table.clear();
 
-    for (Flight f : arriving) {
-        result.insert(f.departure);
+    // copy every flight into the arena once, in frozen order
+    std::vector<Flight*> stored;
+    for (uint32_t k = 0; k < frozen.flights.size(); k++) {
+        stored.push_back(flight_arena.create(frozen.flight(k)));
+        edgeList[frozen.ids[k]] = stored.back();
     }
 
-    std::vector<Airport*> out = std::vector<Airport*>(result.size());
-    std::copy(result.begin(), result.end(), out.begin());
+    for (size_t i = 0; i < frozen.size(); i++) {
+        IncidentEdgeList &incident = vertexList[frozen.airports[i]->airport_id];
 
-    return out;
-}
+        // out_offsets keeps each departing list in order
+        for (uint32_t k = frozen.out_offsets[i]; k < frozen.out_offsets[i + 1]; k++) {
+            incident.departing.push_back(stored[k]);
+        }
 
-std::vector<Airport*> Graph::outgoingNodes(Airport* depart) const {
-    // list of edges connected with the current airport
-    IncidentEdgeList incidentEdgeList = vertexList.at(depart->airport_id);
-    std::list<Flight> departing = incidentEdgeList.departing;
+        for (uint32_t k = frozen.in_offsets[i]; k < frozen.in_offsets[i + 1]; k++) {
+            incident.arriving.push_back(stored[frozen.in_flights[k]]);
+        }
 
-    std::set<Airport*> result;
+        // the neighbour arrays are already distinct and in airport_id order
+        for (uint32_t k = frozen.out_neighbor_offsets[i]; k < frozen.out_neighbor_offsets[i + 1]; k++) {
+            incident.destinations.push_back(frozen.airports[frozen.out_neighbors[k]]);
+        }
 
-    for (Flight f: departing) {
-        // getting the arrival airport where the flights depart at the current airport
-        result.insert(f.arrival);
+        for (uint32_t k = frozen.in_neighbor_offsets[i]; k < frozen.in_neighbor_offsets[i + 1]; k++) {
+            incident.origins.push_back(frozen.airports[frozen.in_neighbors[k]]);
+        }
     }
 
-    std::vector<Airport*> out = std::vector<Airport*>();
+    frozen = FrozenGraph();
+}
+
+bool Graph::areAdjacent(Airport* first, Airport* second) const {
+    if (first == NULL || second == NULL) return false;
 
-    for (Airport *a : result) {
-        out.push_back(a);
+    if (is_frozen) {
+        return frozen.adjacent(frozen.indexOf(first), frozen.indexOf(second));
     }
 
+    const std::vector<Airport*> &from_first = vertexList.at(first->airport_id).destinations;
+    const std::vector<Airport*> &from_second = vertexList.at(second->airport_id).destinations;
+
+    return std::binary_search(from_first.begin(), from_first.end(), second, AirportIdLess()) ||
+           std::binary_search(from_second.begin(), from_second.end(), first, AirportIdLess());
+}
+
+std::vector<Airport*> Graph::incomingNodes(Airport* arrival) const {
+    std::vector<Airport*> out;
+    forEachOrigin(arrival, [&out](Airport *a) { out.push_back(a); });
+
     return out;
 }
 
-std::vector<Airport*> Graph::findFurthestAirports(Airport* start) const {
+std::vector<Airport*> Graph::outgoingNodes(Airport* depart) const {
+    std::vector<Airport*> out;
+    forEachDestination(depart, [&out](Airport *a) { out.push_back(a); });
+
+    return out;
+}
+
+std::vector<Airport*> Graph::findFurthestAirports(Airport* start, size_t *stops) const {
     std::vector<Airport*> furthest;
-    int maxStop = 0;
+    size_t maxStop = 0;
 
-    std::queue<Airport*> airportQueue;
-    std::queue<int> stopsQueue;
+    if (is_frozen) {
+        std::vector<uint32_t> found;
+        maxStop = frozen.furthest(frozen.indexOf(start), found);
+
+        for (uint32_t i : found) furthest.push_back(frozen.airports[i]);
+
+        if (stops != NULL) *stops = maxStop;
+        return furthest;
+    }
 
-    airportQueue.push(start);
-    stopsQueue.push(0);
+    std::queue<std::pair<Airport*, size_t>> airportQueue;
+    airportQueue.push(std::make_pair(start, 0));
 
     std::unordered_set<size_t> visited;
     visited.insert(start->airport_id);
 
     while (!airportQueue.empty()) {
-        Airport* currentAirport = airportQueue.front();
-        int stopNum = stopsQueue.front();
+        Airport* currentAirport = airportQueue.front().first;
+        size_t stopNum = airportQueue.front().second;
         airportQueue.pop();
-        stopsQueue.pop();
 
         if (maxStop < stopNum) {
             maxStop = stopNum;
             furthest.clear();
         }
 
-        std::vector<Airport*> neighbors = outgoingNodes(currentAirport);
+        forEachDestination(currentAirport, [&](Airport *airport) {
+            if (visited.insert(airport->airport_id).second) airportQueue.push(std::make_pair(airport, stopNum + 1));
+        });
 
-        for (Airport*& airport: neighbors) {
-            if (visited.count(airport->airport_id) == 0) {
-                airportQueue.push(airport);
-                stopsQueue.push(stopNum + 1);
-                visited.insert(airport->airport_id);
-            }
-        }
         furthest.push_back(currentAirport);
     }
 
+    // the same order as the frozen search
+    std::sort(furthest.begin(), furthest.end(), AirportIdLess());
+
+    if (stops != NULL) *stops = maxStop;
     return furthest;
 }
 
+data::Eccentricities Graph::eccentricities() const {
+    // an unfrozen graph has no neighbour arrays, so build them for this query
+    FrozenGraph built;
+    if (!is_frozen) built = FrozenGraph(vertexList);
+    const FrozenGraph &g = is_frozen ? frozen : built;
+
+    std::vector<uint32_t> eccentricity;
+    std::vector<std::vector<uint32_t>> furthest;
+    g.allEccentricities(eccentricity, furthest);
+
+    Eccentricities result;
+    result.airports = g.airports;
+    result.radius = SIZE_MAX;
+
+    for (uint32_t i = 0; i < g.size(); i++) {
+        result.eccentricity.push_back(eccentricity[i]);
+        result.furthest.push_back(std::vector<Airport*>());
+
+        for (uint32_t k : furthest[i]) result.furthest.back().push_back(g.airports[k]);
+
+        result.diameter = std::max<size_t>(result.diameter, eccentricity[i]);
+        if (eccentricity[i] > 0) result.radius = std::min<size_t>(result.radius, eccentricity[i]);
+    }
+
+    if (result.radius == SIZE_MAX) result.radius = 0;
+
+    return result;
+}
+
 size_t Graph::stopCount(Airport* start) const {
-    int maxStop = 0;
+    size_t stops;
+    findFurthestAirports(start, &stops);
 
-    std::queue<Airport*> airportQueue;
-    std::queue<int> stopsQueue;
+    return stops;
+}
 
-    airportQueue.push(start);
-    stopsQueue.push(0);
+size_t Graph::stops(Airport *depart, Airport *arrive) const {
+    // an unfrozen graph has no neighbour arrays, so build them for this query
+    FrozenGraph built;
+    if (!is_frozen) built = FrozenGraph(vertexList);
+    const FrozenGraph &g = is_frozen ? frozen : built;
 
-    std::unordered_set<size_t> visited;
-    visited.insert(start->airport_id);
+    auto from = g.airport_index.find(depart->airport_id);
+    auto to = g.airport_index.find(arrive->airport_id);
+    if (from == g.airport_index.end() || to == g.airport_index.end()) throw -1;
 
-    while (!airportQueue.empty()) {
-        Airport* currentAirport = airportQueue.front();
-        int stopNum = stopsQueue.front();
-        airportQueue.pop();
-        stopsQueue.pop();
+    uint8_t count = hasStopTable() ? stop_table[from->second * g.size() + to->second] : g.stops(from->second, to->second);
+    if (count == FrozenGraph::NO_ROUTE) throw -1;
 
-        if (maxStop < stopNum) {
-            maxStop = stopNum;
-        }
+    return count;
+}
 
-        std::vector<Airport*> neighbors = outgoingNodes(currentAirport);
+void Graph::computeStopTable(size_t threads) {
+    freeze();
+    frozen.stopTable(stop_table, threads);
+}
 
-        for (Airport*& airport: neighbors) {
-            if (visited.count(airport->airport_id) == 0) {
-                airportQueue.push(airport);
-                stopsQueue.push(stopNum + 1);
-                visited.insert(airport->airport_id);
-            }
-        }
-    }
+void Graph::setStopTable(std::vector<uint8_t> table) {
+    freeze();
+    if (table.size() != frozen.size() * frozen.size()) throw -1;
 
-    return maxStop;
+    stop_table.swap(table);
 }
 
-std::vector<Airport*> Graph::rankAirports() const {
-    std::vector<Airport*> airports = getAirports();
+namespace {
+    /** Sort airports by score, highest first, breaking ties by airport_id. Only the first top airports are sorted and returned.
+     * Sorts indices into scores, so it runs in O(n log top).
+     */
+    std::vector<std::pair<Airport*, double>> sortByScore(const std::vector<Airport*> &airports, const std::vector<double> &scores, size_t top) {
+        std::vector<size_t> order(airports.size());
+        for (size_t i = 0; i < order.size(); i++) order[i] = i;
+
+        auto higher = [&airports, &scores](size_t a, size_t b) {
+            if (scores[a] != scores[b]) return scores[a] > scores[b];
+            return airports[a]->airport_id < airports[b]->airport_id;
+        };
+
+        top = std::min(top, order.size());
+        std::partial_sort(order.begin(), order.begin() + top, order.end(), higher);
+
+        std::vector<std::pair<Airport*, double>> ranking;
+        for (size_t i = 0; i < top; i++) ranking.push_back(std::pair<Airport*, double>(airports[order[i]], scores[order[i]]));
+
+        return ranking;
+    }
+}
 
+utils::SparseMatrix Graph::transitionMatrix(const std::vector<Airport*> &airports) const {
     std::unordered_map<size_t, size_t> airport_id_to_number;
 
     size_t id = 0;
@@ -251,65 +522,273 @@ std::vector<Airport*> Graph::rankAirports() const {
         airport_id_to_number[a -> airport_id] = id++;
     }
 
-    std::vector<Flight> flights = getFlights();
+    // one entry per flight, added together per route by utils::sparseMatrix
+    std::vector<utils::MatrixEntry> entries;
+    std::vector<double> column_sums(airports.size(), 0);
 
-    std::vector<std::vector<double>> transition_matrix = std::vector<std::vector<double>>(airports.size(), std::vector<double>(airports.size(), 0));
+    auto addFlight = [&](size_t depart_idx, size_t arrive_idx, Frequency frequency) {
+        size_t increment = monthlyCount(frequency);
 
-    for (Flight f : flights) {
-        size_t increment = 0;
+        entries.push_back(utils::MatrixEntry{arrive_idx, depart_idx, (double) increment});
+        column_sums[depart_idx] += increment;
+    };
 
-        switch (f.frequency) {
-            case data::DAILY:
-                increment = 7 * 4;
-                break;
-            case data::WEEKLY:
-                increment = 4;
-                break;
-            case data::MONTHLY:
-                increment = 1;
-                break;
+    if (is_frozen) {
+        // read the flight records in place, with their dense indices mapped to rows once
+        std::vector<size_t> dense_to_number(frozen.size());
+        for (uint32_t i = 0; i < frozen.size(); i++) dense_to_number[i] = airport_id_to_number[frozen.airports[i]->airport_id];
+
+        for (const FlightRecord &f : frozen.flights) {
+            addFlight(dense_to_number[f.departure], dense_to_number[f.arrival], (Frequency) f.frequency);
         }
-        
-        size_t depart_idx = airport_id_to_number[f.departure->airport_id];
-        size_t arrive_idx = airport_id_to_number[f.arrival->airport_id];
+    } else {
+        for (const Flight &f : getFlights()) {
+            addFlight(airport_id_to_number[f.departure->airport_id], airport_id_to_number[f.arrival->airport_id], f.frequency);
+        }
+    }
+
+    // Normalize columns of transition matrix! Airports with no departures have no entries to normalize.
+    for (utils::MatrixEntry &e : entries) e.value /= column_sums[e.col];
+
+    return utils::sparseMatrix(airports.size(), airports.size(), entries);
+}
+
+std::vector<data::UnmetDemand> Graph::unmetDemand(size_t top, size_t threads) const {
+    FrozenGraph built;
+    if (!is_frozen) built = FrozenGraph(vertexList);
+    const FrozenGraph &g = is_frozen ? frozen : built;
+
+    // PageRank scores add up to 1, so scale them to keep the scores readable
+    std::vector<double> mass(g.size(), 0);
+    for (const std::pair<Airport*, double> &ranked : rankAirports(RankOptions(), SIZE_MAX, NULL, threads)) mass[g.indexOf(ranked.first)] = ranked.second * g.size();
+
+    return g.unmetDemand(mass, top, threads);
+}
+
+std::vector<std::pair<Airport*, double>> Graph::rankAirports(size_t top, RankStats *stats, size_t threads) const {
+    std::vector<Airport*> airports = getAirports();
+    if (airports.empty()) return std::vector<std::pair<Airport*, double>>();
+
+    utils::SparseMatrix transition_matrix = transitionMatrix(airports);
+
+    std::vector<double> steady_state = std::vector<double>(airports.size(), 0.0);
+    steady_state[0] = 1.0;
+
+    // Use power iteration to find the steady state, stopping once it converges.
+    double residual = 0;
+    size_t iterations = utils::powerIteration(transition_matrix, steady_state, 1e-12, steady_state.size() * 30, residual, threads);
+
+    if (stats) {
+        stats->iterations = iterations;
+        stats->residual = residual;
+        stats->warm_start = false;
+    }
+
+    return sortByScore(airports, steady_state, top);
+}
+
+std::vector<std::pair<Airport*, double>> Graph::rankAirports(const RankOptions &options, size_t top, RankStats *stats, size_t threads) const {
+    std::vector<Airport*> airports = getAirports();
+    if (airports.empty()) return std::vector<std::pair<Airport*, double>>();
+
+    utils::SparseMatrix transition_matrix = transitionMatrix(airports);
+
+    std::unordered_map<size_t, size_t> airport_id_to_number;
+    for (size_t i = 0; i < airports.size(); i++) airport_id_to_number[airports[i]->airport_id] = i;
+
+    // jump to every airport equally, or only to the ones asked for
+    std::vector<double> personalization(airports.size(), options.personalization.empty() ? 1.0 : 0.0);
 
-        transition_matrix[arrive_idx][depart_idx] += increment;
+    for (const std::pair<Airport*, double> &p : options.personalization) {
+        auto found = airport_id_to_number.find(p.first->airport_id);
+        if (found == airport_id_to_number.end()) throw -1;
 
+        personalization[found->second] += p.second;
     }
 
-    // Normalize columns of transition matrix!
-    for (size_t j = 0; j < transition_matrix[0].size(); j++) {
-        double sum = 0;
+    // warm start from the last ranking if it was over the same airports
+    bool warm_start = rank_airports == airports;
+    std::vector<double> steady_state = warm_start ? rank_state : std::vector<double>(airports.size(), 0.0);
+
+    double residual = 0;
+    size_t iterations = utils::pageRank(transition_matrix, steady_state, personalization, options.damping, 1e-12,
+                                        steady_state.size() * 30, residual, threads);
+
+    rank_airports = airports;
+    rank_state = steady_state;
 
-        for (size_t i = 0; i < transition_matrix.size(); i++) sum += transition_matrix[i][j];
-        for (size_t i = 0; i < transition_matrix.size(); i++) transition_matrix[i][j] /= sum;
+    if (stats) {
+        stats->iterations = iterations;
+        stats->residual = residual;
+        stats->warm_start = warm_start;
     }
 
-    std::vector<double> starting_state = std::vector<double>(airports.size(), 0.0);
-    starting_state[0] = 1.0;
+    return sortByScore(airports, steady_state, top);
+}
 
-    // Use power iteration to find the steady state.
-    std::vector<double> steady_state = utils::powerIteration(transition_matrix, starting_state, starting_state.size() * 30);
+void Graph::trackRanking(double damping, size_t threads) {
+    is_tracking = false;
+    tracked_rank = IncrementalRank();
+    tracked_rank.damping = damping;
+    tracked_rank.threads = threads;
 
-    // sort in reverse order
-    std::vector<double> steady_sorted = steady_state;
-    std::sort(steady_sorted.begin(), steady_sorted.end(), std::greater<double>());
+    std::vector<Airport*> airports = getAirports();
+    IncrementalRank &r = tracked_rank;
+    size_t n = airports.size();
 
-    std::vector<Airport*> airports_sorted = std::vector<Airport*>(airports.size());
+    r.airports = airports;
+    for (uint32_t i = 0; i < n; i++) r.index[airports[i]->airport_id] = i;
 
-    for (size_t i = 0; i < steady_state.size(); i++) {
-        for (size_t j = 0; j < steady_sorted.size(); j++) {
-            if (steady_state[i] == steady_sorted[j] && !airports_sorted[j] &&airports[i]) {
-                airports_sorted[j] = airports[i];
-                airports[i] = NULL;
-            }
+    r.routes.resize(n);
+    r.out_weight.assign(n, 0);
+
+    auto addFlight = [&r](uint32_t from, uint32_t to, Frequency frequency) {
+        r.routes[from][to] += monthlyCount(frequency);
+        r.out_weight[from] += monthlyCount(frequency);
+    };
+
+    if (is_frozen) {
+        std::vector<uint32_t> dense_to_index(frozen.size());
+        for (uint32_t i = 0; i < frozen.size(); i++) dense_to_index[i] = r.index.at(frozen.airports[i]->airport_id);
+
+        for (const FlightRecord &f : frozen.flights) {
+            addFlight(dense_to_index[f.departure], dense_to_index[f.arrival], (Frequency) f.frequency);
+        }
+    } else {
+        for (const Flight &f : getFlights()) {
+            addFlight(r.index.at(f.departure->airport_id), r.index.at(f.arrival->airport_id), f.frequency);
+        }
+    }
+
+    is_tracking = true;
+    if (n == 0) return;
+
+    // start from a full PageRank, then work out the residual it leaves
+    r.score.assign(n, 0);
+    double residual = 0;
+    utils::pageRank(transitionMatrix(airports), r.score, std::vector<double>(n, 1.0), damping, 1e-12, n * 30, residual, r.threads);
+
+    std::vector<double> moved(n, 0);
+    double dangling = 0;
+
+    for (uint32_t u = 0; u < n; u++) {
+        if (r.out_weight[u] == 0) dangling += r.score[u];
+
+        for (const std::pair<const uint32_t, double> &route : r.routes[u]) {
+            moved[route.first] += r.score[u] * route.second / r.out_weight[u];
+        }
+    }
+
+    r.residual.assign(n, 0);
+    std::vector<uint32_t> changed;
+
+    for (uint32_t w = 0; w < n; w++) {
+        r.residual[w] = (1 - damping) / n - r.score[w] + damping * (moved[w] + dangling / n);
+        changed.push_back(w);
+    }
+
+    r.push(changed);
+}
+
+std::vector<std::pair<Airport*, double>> Graph::trackedRanking(size_t top, RankStats *stats) const {
+    if (!is_tracking) throw -1;
+
+    const IncrementalRank &r = tracked_rank;
+
+    double sum = 0;
+    for (double x : r.score) sum += x;
+
+    std::vector<double> scores = r.score;
+    if (sum > 0) for (double &x : scores) x /= sum;
+
+    if (stats) {
+        stats->iterations = r.pushes;
+        stats->residual = 0;
+        for (double x : r.residual) stats->residual = std::max(stats->residual, std::abs(x));
+        stats->warm_start = true;
+    }
+
+    return sortByScore(r.airports, scores, top);
+}
+
+std::vector<std::pair<Airport*, double>> Graph::airlineHubs(const std::string &airline) const {
+    std::unordered_map<size_t, double> departures;
+
+    // an airline no flight has used has no hubs
+    Carrier carrier;
+    if (!Carrier::find(airline, carrier) || flightCount(carrier) == 0) return std::vector<std::pair<Airport*, double>>();
+
+    if (is_frozen) {
+        for (const FlightRecord &f : frozen.flights) {
+            if (f.carrier == carrier) departures[frozen.airports[f.departure]->airport_id] += monthlyCount((Frequency) f.frequency);
+        }
+    } else {
+        for (const Flight &f : getFlights()) {
+            if (f.airline == carrier) departures[f.departure->airport_id] += monthlyCount(f.frequency);
         }
     }
 
-    return airports_sorted;
+    std::vector<std::pair<Airport*, double>> hubs;
+
+    for (auto i = departures.begin(); i != departures.end(); i++) {
+        hubs.push_back(std::pair<Airport*, double>(getVertex(i->first), i->second));
+    }
+
+    return hubs;
 }
 
 std::vector<Flight> Graph::shortestPath(Airport *depart, Airport* arrive, size_t departTime, size_t minConnectionTime) const {
+    if (is_frozen) {
+        auto start = frozen.airport_index.find(depart->airport_id);
+        auto end = frozen.airport_index.find(arrive->airport_id);
+        if (start == frozen.airport_index.end() || end == frozen.airport_index.end()) throw -1;
+
+        // same search as below, over dense indices: the flight used to reach each airport, and when we get there
+        const uint32_t NONE = UINT32_MAX;
+        std::vector<bool> reached(frozen.size(), false);
+        std::vector<size_t> arrive_time(frozen.size());
+        std::vector<uint32_t> via(frozen.size(), NONE);
+
+        std::vector<uint32_t> q;
+        q.push_back(start->second);
+        reached[start->second] = true;
+        arrive_time[start->second] = departTime;
+
+        std::vector<uint32_t> catchable;
+
+        for (size_t head = 0; head < q.size(); head++) {
+            uint32_t check = q[head];
+
+            // binary search for the first flight we can catch, then take them back to departing list order
+            catchable.assign(frozen.out_by_time.begin() + frozen.firstDeparture(check, minConnectionTime + arrive_time[check]),
+                             frozen.out_by_time.begin() + frozen.out_offsets[check + 1]);
+            std::sort(catchable.begin(), catchable.end());
+
+            for (uint32_t k : catchable) {
+                uint32_t next = frozen.flights[k].arrival;
+
+                if (!reached[next]) {
+                    reached[next] = true;
+                    arrive_time[next] = frozen.flights[k].arrive_time;
+                    via[next] = k;
+                    q.push_back(next);
+                }
+            }
+        }
+
+        // depart -> arrive are not connected
+        if (!reached[end->second]) throw -1;
+
+        std::vector<Flight> path;
+
+        for (uint32_t current = end->second; current != start->second; current = frozen.indexOf(path.back().departure)) {
+            path.push_back(frozen.flight(via[current]));
+        }
+
+        std::reverse(path.begin(), path.end());
+        return path;
+    }
+
     std::queue<Airport> q;
 
     // map from airport to arrival time at that airport
@@ -327,7 +806,8 @@ std::vector<Flight> Graph::shortestPath(Airport *depart, Airport* arrive, size_t
 
         // Enqueue all outgoing nodes with flights after (time you arrive at that node) 
         // if time of arrival + connection < shortestSoFar, add that flight to the map
-        for (Flight f: (vertexList.find(check.airport_id) -> second.departing)) {
+        for (const Flight *stored : (vertexList.find(check.airport_id) -> second.departing)) {
+            const Flight &f = *stored;
 
             if (f.depart_time >= minConnectionTime + arrive_time[*f.departure].arrive_time) {
                 
@@ -358,3 +838,684 @@ std::vector<Flight> Graph::shortestPath(Airport *depart, Airport* arrive, size_t
     std::reverse(path.begin(), path.end());
     return path;
 }
+
+std::vector<Flight> Graph::earliestArrival(Airport *depart, Airport* arrive, size_t departTime, size_t minConnectionTime) const {
+    // an unfrozen graph has no connection array, so build one for this query
+    FrozenGraph built;
+    if (!is_frozen) built = FrozenGraph(vertexList);
+    const FrozenGraph &g = is_frozen ? frozen : built;
+
+    auto start = g.airport_index.find(depart->airport_id);
+    auto end = g.airport_index.find(arrive->airport_id);
+    if (start == g.airport_index.end() || end == g.airport_index.end()) throw -1;
+
+    // earliest arrival at each airport, and the connection used to get there
+    const size_t NEVER = SIZE_MAX;
+    std::vector<size_t> earliest(g.size(), NEVER);
+    std::vector<uint32_t> via(g.size(), UINT32_MAX);
+    earliest[start->second] = departTime;
+
+    for (uint32_t c = g.firstConnection(departTime); c < g.connections.size(); c++) {
+        const data::Connection &conn = g.connections[c];
+
+        // every connection from here on leaves after we have already arrived
+        if (conn.depart_time >= earliest[end->second]) break;
+        if (earliest[conn.departure] == NEVER) continue;
+
+        size_t ready = earliest[conn.departure] + (conn.departure == start->second ? 0 : minConnectionTime);
+
+        if (conn.depart_time >= ready && conn.arrive_time < earliest[conn.arrival]) {
+            earliest[conn.arrival] = conn.arrive_time;
+            via[conn.arrival] = c;
+        }
+    }
+
+    // depart -> arrive are not connected
+    if (earliest[end->second] == NEVER) throw -1;
+
+    std::vector<Flight> path;
+
+    for (uint32_t current = end->second; current != start->second; current = g.connections[via[current]].departure) {
+        path.push_back(g.flight(g.connections[via[current]].flight));
+    }
+
+    std::reverse(path.begin(), path.end());
+    return path;
+}
+
+std::vector<std::vector<Flight>> Graph::profile(Airport *depart, Airport* arrive, size_t minConnectionTime) const {
+    // an unfrozen graph has no connection array, so build one for this query
+    FrozenGraph built;
+    if (!is_frozen) built = FrozenGraph(vertexList);
+    const FrozenGraph &g = is_frozen ? frozen : built;
+
+    auto start = g.airport_index.find(depart->airport_id);
+    auto end = g.airport_index.find(arrive->airport_id);
+    if (start == g.airport_index.end() || end == g.airport_index.end()) throw -1;
+
+    // a departure time from an airport, when it gets to arrive, and the first connection taken
+    struct Entry {
+        uint32_t depart_time;
+        uint32_t arrive_time;
+        uint32_t connection;
+    };
+
+    // Pareto profile of every airport, latest departure first
+    std::vector<std::vector<Entry>> profiles(g.size());
+
+    // the itinerary leaving airport at or after time that arrives first, or NULL if there is none
+    auto evaluate = [&profiles](uint32_t airport, size_t time) -> const Entry* {
+        const std::vector<Entry> &p = profiles[airport];
+        auto after = std::partition_point(p.begin(), p.end(), [time](const Entry &e) { return e.depart_time >= time; });
+
+        return after == p.begin() ? NULL : &*(after - 1);
+    };
+
+    for (size_t c = g.connections.size(); c-- > 0;) {
+        const data::Connection &conn = g.connections[c];
+        if (conn.departure == end->second) continue;
+
+        uint32_t best = UINT32_MAX;
+
+        if (conn.arrival == end->second) {
+            best = conn.arrive_time;
+        } else if (const Entry *next = evaluate(conn.arrival, conn.arrive_time + minConnectionTime)) {
+            best = next->arrive_time;
+        }
+
+        // keep the entry only if no later departure arrives as early
+        std::vector<Entry> &p = profiles[conn.departure];
+        if (best == UINT32_MAX || (!p.empty() && p.back().arrive_time <= best)) continue;
+
+        if (!p.empty() && p.back().depart_time == conn.depart_time) p.pop_back();
+        p.push_back(Entry{conn.depart_time, best, (uint32_t) c});
+    }
+
+    std::vector<std::vector<Flight>> journeys;
+
+    for (auto e = profiles[start->second].rbegin(); e != profiles[start->second].rend(); e++) {
+        std::vector<Flight> path;
+        const Entry *current = &*e;
+
+        while (true) {
+            const data::Connection &conn = g.connections[current->connection];
+            path.push_back(g.flight(conn.flight));
+
+            if (conn.arrival == end->second) break;
+            current = evaluate(conn.arrival, conn.arrive_time + minConnectionTime);
+        }
+
+        journeys.push_back(path);
+    }
+
+    return journeys;
+}
+
+void data::IncrementalRank::addFlight(uint32_t from, uint32_t to, double weight) {
+    std::vector<uint32_t> changed;
+    size_t n = airports.size();
+
+    // the old column of P sent score[from] along the old routes (or everywhere, if from had no flights)
+    double change = damping * score[from];
+
+    if (out_weight[from] == 0) {
+        for (uint32_t w = 0; w < n; w++) {
+            residual[w] -= change / n;
+            changed.push_back(w);
+        }
+    } else {
+        for (const std::pair<const uint32_t, double> &route : routes[from]) {
+            residual[route.first] -= change * route.second / out_weight[from];
+            changed.push_back(route.first);
+        }
+    }
+
+    routes[from][to] += weight;
+    out_weight[from] += weight;
+
+    for (const std::pair<const uint32_t, double> &route : routes[from]) {
+        residual[route.first] += change * route.second / out_weight[from];
+        changed.push_back(route.first);
+    }
+
+    push(changed);
+}
+
+void data::IncrementalRank::push(const std::vector<uint32_t> &changed) {
+    size_t n = airports.size();
+
+    std::queue<uint32_t> queue;
+    std::vector<bool> queued(n, false);
+
+    auto add = [&](uint32_t airport, double amount) {
+        residual[airport] += amount;
+
+        if (!queued[airport] && std::abs(residual[airport]) > tolerance) {
+            queued[airport] = true;
+            queue.push(airport);
+        }
+    };
+
+    for (uint32_t u : changed) add(u, 0);
+
+    while (!queue.empty()) {
+        uint32_t u = queue.front();
+        queue.pop();
+        queued[u] = false;
+
+        double amount = residual[u];
+        if (std::abs(amount) <= tolerance) continue;
+
+        residual[u] = 0;
+        score[u] += amount;
+        pushes++;
+
+        // airports with no flights jump anywhere
+        if (out_weight[u] == 0) {
+            for (uint32_t w = 0; w < n; w++) add(w, damping * amount / n);
+            continue;
+        }
+
+        for (const std::pair<const uint32_t, double> &route : routes[u]) {
+            add(route.first, damping * amount * route.second / out_weight[u]);
+        }
+    }
+}
+
+data::FrozenGraph::FrozenGraph(const std::unordered_map<size_t, IncidentEdgeList> &vertexList) {
+    // dense indices in airport_id order (the order outgoingNodes and incomingNodes use)
+    for (auto i = vertexList.begin(); i != vertexList.end(); i++) {
+        Airport *a = i->second.airport;
+
+        // createEdge adds airports that were never passed to createVertex, take them from their flights
+        if (a == NULL) a = i->second.departing.empty() ? i->second.arriving.front()->arrival : i->second.departing.front()->departure;
+
+        airports.push_back(a);
+    }
+
+    std::sort(airports.begin(), airports.end(), data::AirportIdLess());
+
+    for (uint32_t i = 0; i < airports.size(); i++) {
+        airport_index[airports[i]->airport_id] = i;
+    }
+
+    // outgoing flights, in departing list order, packed into records
+    out_offsets.push_back(0);
+
+    for (Airport *a : airports) {
+        for (const Flight *f : vertexList.at(a->airport_id).departing) {
+            // times are minutes from midnight, anything that does not fit a record is not a time,
+            // and no flight is 65535 miles or minutes long
+            if (f->depart_time > UINT16_MAX || f->arrive_time > UINT16_MAX) throw -1;
+            if (f->distance > UINT16_MAX || f->airtime > UINT16_MAX) throw -1;
+
+            FlightRecord record;
+            record.departure = out_offsets.size() - 1;
+            record.arrival = airport_index.at(f->arrival->airport_id);
+            record.depart_time = f->depart_time;
+            record.arrive_time = f->arrive_time;
+            record.distance = f->distance;
+            record.airtime = f->airtime;
+            record.carrier = f->airline;
+            record.weekday = f->weekday;
+            record.frequency = f->frequency;
+
+            flights.push_back(record);
+            ids.push_back(f->flight_id);
+        }
+
+        out_offsets.push_back(flights.size());
+    }
+
+    // departures by time, ties kept in departing list order
+    out_by_time.resize(flights.size());
+
+    for (uint32_t i = 0; i < airports.size(); i++) {
+        auto first = out_by_time.begin() + out_offsets[i];
+        auto last = out_by_time.begin() + out_offsets[i + 1];
+
+        for (uint32_t k = out_offsets[i]; k < out_offsets[i + 1]; k++) out_by_time[k] = k;
+        std::stable_sort(first, last, [this](uint32_t a, uint32_t b) { return flights[a].depart_time < flights[b].depart_time; });
+    }
+
+    // incoming flights, bucketed by arrival airport
+    in_offsets.assign(airports.size() + 1, 0);
+    for (uint32_t k = 0; k < flights.size(); k++) in_offsets[flights[k].arrival + 1]++;
+    for (size_t i = 0; i < airports.size(); i++) in_offsets[i + 1] += in_offsets[i];
+
+    in_flights.resize(flights.size());
+    std::vector<uint32_t> next(in_offsets.begin(), in_offsets.end() - 1);
+    for (uint32_t k = 0; k < flights.size(); k++) in_flights[next[flights[k].arrival]++] = k;
+
+    // distinct neighbours, sorted by dense index
+    out_neighbor_offsets.push_back(0);
+    in_neighbor_offsets.push_back(0);
+
+    for (uint32_t i = 0; i < airports.size(); i++) {
+        size_t start = out_neighbors.size();
+        for (uint32_t k = out_offsets[i]; k < out_offsets[i + 1]; k++) out_neighbors.push_back(flights[k].arrival);
+        std::sort(out_neighbors.begin() + start, out_neighbors.end());
+        out_neighbors.erase(std::unique(out_neighbors.begin() + start, out_neighbors.end()), out_neighbors.end());
+        out_neighbor_offsets.push_back(out_neighbors.size());
+
+        // in_flights is already sorted by departure airport, so only duplicates need removing
+        uint32_t last = UINT32_MAX;
+        for (uint32_t k = in_offsets[i]; k < in_offsets[i + 1]; k++) {
+            uint32_t from = flights[in_flights[k]].departure;
+            if (from != last) in_neighbors.push_back(from);
+            last = from;
+        }
+        in_neighbor_offsets.push_back(in_neighbors.size());
+    }
+
+    // adjacency bits, set both ways for each route
+    if (airports.size() <= ADJACENCY_MAX_AIRPORTS) {
+        adjacency_words = (airports.size() + 63) / 64;
+        adjacency.assign(airports.size() * adjacency_words, 0);
+
+        for (uint32_t i = 0; i < airports.size(); i++) {
+            for (uint32_t k = out_neighbor_offsets[i]; k < out_neighbor_offsets[i + 1]; k++) {
+                uint32_t j = out_neighbors[k];
+                adjacency[i * adjacency_words + j / 64] |= uint64_t(1) << (j % 64);
+                adjacency[j * adjacency_words + i / 64] |= uint64_t(1) << (i % 64);
+            }
+        }
+    }
+
+    // connections for the Connection Scan Algorithm, skipping flights that land the next day
+    for (uint32_t i = 0; i < airports.size(); i++) {
+        for (uint32_t k = out_offsets[i]; k < out_offsets[i + 1]; k++) {
+            if (flights[k].arrive_time < flights[k].depart_time) continue;
+
+            connections.push_back(Connection{i, flights[k].arrival, flights[k].depart_time, flights[k].arrive_time, k});
+        }
+    }
+
+    std::stable_sort(connections.begin(), connections.end(), [](const Connection &a, const Connection &b) {
+        return a.depart_time < b.depart_time || (a.depart_time == b.depart_time && a.arrive_time < b.arrive_time);
+    });
+
+    for (uint32_t k = 0; k < flights.size(); k++) {
+        flight_ids.push_back(std::pair<size_t, uint32_t>(ids[k], k));
+    }
+
+    std::sort(flight_ids.begin(), flight_ids.end());
+}
+
+Flight data::FrozenGraph::flight(uint32_t k) const {
+    const FlightRecord &record = flights[k];
+
+    Flight f;
+    f.departure = airports[record.departure];
+    f.arrival = airports[record.arrival];
+    f.depart_time = record.depart_time;
+    f.arrive_time = record.arrive_time;
+    f.weekday = record.weekday;
+    f.airline = record.carrier;
+    f.flight_id = ids[k];
+    f.distance = record.distance;
+    f.airtime = record.airtime;
+    f.frequency = (Frequency) record.frequency;
+
+    return f;
+}
+
+uint32_t data::FrozenGraph::firstDeparture(uint32_t airport, size_t time) const {
+    auto found = std::lower_bound(out_by_time.begin() + out_offsets[airport], out_by_time.begin() + out_offsets[airport + 1], time,
+                                  [this](uint32_t k, size_t t) { return flights[k].depart_time < t; });
+
+    return found - out_by_time.begin();
+}
+
+uint32_t data::FrozenGraph::firstConnection(size_t time) const {
+    auto found = std::lower_bound(connections.begin(), connections.end(), time,
+                                  [](const Connection &c, size_t t) { return c.depart_time < t; });
+
+    return found - connections.begin();
+}
+
+bool data::FrozenGraph::hasFlight(uint32_t first, uint32_t second) const {
+    return std::binary_search(out_neighbors.begin() + out_neighbor_offsets[first],
+                              out_neighbors.begin() + out_neighbor_offsets[first + 1], second);
+}
+
+bool data::FrozenGraph::adjacent(uint32_t first, uint32_t second) const {
+    if (!adjacency.empty()) return (adjacency[first * adjacency_words + second / 64] >> (second % 64)) & 1;
+
+    return hasFlight(first, second) || hasFlight(second, first);
+}
+
+namespace {
+    /** Breadth-first search from up to 64 airports at once, the dense indices first to first + 63 (or the last airport).
+     * Calls found(level, airport, sources) each time an airport is reached for the first time by some of the sources,
+     * where bit b of sources stands for first + b. Level 0 is each source reaching itself.
+     * seen, visit and next are scratch space, with one entry per airport, that can be reused between calls.
+     */
+    template <typename Found>
+    void batchBfs(const data::FrozenGraph &g, size_t first, std::vector<uint64_t> &seen, std::vector<uint64_t> &visit,
+                  std::vector<uint64_t> &next, Found found) {
+        size_t n = g.size();
+        size_t lanes = std::min<size_t>(64, n - first);
+
+        // bit b of seen[v] is set once source first + b has reached v, visit holds the current level's frontier
+        std::fill(seen.begin(), seen.end(), 0);
+        std::fill(visit.begin(), visit.end(), 0);
+
+        for (size_t b = 0; b < lanes; b++) {
+            seen[first + b] |= uint64_t(1) << b;
+            visit[first + b] |= uint64_t(1) << b;
+            found(0, first + b, uint64_t(1) << b);
+        }
+
+        bool active = true;
+
+        for (uint32_t level = 1; active; level++) {
+            active = false;
+            std::fill(next.begin(), next.end(), 0);
+
+            // every source in an airport's frontier moves on to all its neighbours at once
+            for (uint32_t v = 0; v < n; v++) {
+                if (visit[v] == 0) continue;
+
+                for (uint32_t k = g.out_neighbor_offsets[v]; k < g.out_neighbor_offsets[v + 1]; k++) {
+                    next[g.out_neighbors[k]] |= visit[v];
+                }
+            }
+
+            for (uint32_t w = 0; w < n; w++) {
+                uint64_t reached = next[w] & ~seen[w];
+                visit[w] = reached;
+                if (reached == 0) continue;
+
+                seen[w] |= reached;
+                active = true;
+
+                found(level, w, reached);
+            }
+        }
+    }
+}
+
+void data::FrozenGraph::allEccentricities(std::vector<uint32_t> &eccentricity, std::vector<std::vector<uint32_t>> &furthest) const {
+    size_t n = size();
+
+    eccentricity.assign(n, 0);
+    furthest.assign(n, std::vector<uint32_t>());
+
+    std::vector<uint64_t> seen(n), visit(n), next(n);
+
+    for (size_t first = 0; first < n; first += 64) {
+        batchBfs(*this, first, seen, visit, next, [&](uint32_t level, uint32_t w, uint64_t sources) {
+            // w is at least as far as anything else these sources have reached so far
+            for (uint64_t bits = sources; bits; bits &= bits - 1) {
+                size_t source = first + __builtin_ctzll(bits);
+
+                if (eccentricity[source] < level) {
+                    eccentricity[source] = level;
+                    furthest[source].clear();
+                }
+
+                furthest[source].push_back(w);
+            }
+        });
+    }
+}
+
+void data::FrozenGraph::stopTable(std::vector<uint8_t> &table, size_t threads) const {
+    size_t n = size();
+    size_t batches = (n + 63) / 64;
+
+    table.assign(n * n, NO_ROUTE);
+    threads = std::max<size_t>(1, std::min(threads, batches));
+
+    // set by a thread that finds a pair too many flights apart to store
+    std::vector<char> too_far(threads, 0);
+
+    // each thread takes every threads-th batch of 64 sources, and writes only their rows
+    auto work = [&](size_t t) {
+        std::vector<uint64_t> seen(n), visit(n), next(n);
+
+        for (size_t batch = t; batch < batches; batch += threads) {
+            size_t first = batch * 64;
+
+            batchBfs(*this, first, seen, visit, next, [&](uint32_t level, uint32_t w, uint64_t sources) {
+                if (level >= NO_ROUTE) {
+                    too_far[t] = 1;
+                    return;
+                }
+
+                for (uint64_t bits = sources; bits; bits &= bits - 1) {
+                    table[(first + __builtin_ctzll(bits)) * n + w] = level;
+                }
+            });
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < threads; t++) workers.emplace_back(work, t);
+    work(0);
+
+    for (std::thread &worker : workers) worker.join();
+
+    if (std::find(too_far.begin(), too_far.end(), 1) != too_far.end()) {
+        table.clear();
+        throw -1;
+    }
+}
+
+std::vector<data::UnmetDemand> data::FrozenGraph::unmetDemand(const std::vector<double> &mass, size_t top, size_t threads) const {
+    uint32_t n = size();
+
+    // the shortest distance and monthly flights of each route, in out_neighbors order and again in in_neighbors order
+    std::vector<uint32_t> out_distance(out_neighbors.size(), UINT32_MAX);
+    std::vector<uint32_t> out_count(out_neighbors.size(), 0);
+
+    for (uint32_t i = 0; i < n; i++) {
+        for (uint32_t k = out_offsets[i]; k < out_offsets[i + 1]; k++) {
+            const FlightRecord &record = flights[k];
+            size_t r = std::lower_bound(out_neighbors.begin() + out_neighbor_offsets[i], out_neighbors.begin() + out_neighbor_offsets[i + 1],
+                                        record.arrival) - out_neighbors.begin();
+
+            out_distance[r] = std::min<uint32_t>(out_distance[r], record.distance);
+            out_count[r] += monthlyCount((Frequency) record.frequency);
+        }
+    }
+
+    std::vector<uint32_t> in_distance(in_neighbors.size());
+    std::vector<uint32_t> in_count(in_neighbors.size());
+
+    for (uint32_t i = 0; i < n; i++) {
+        for (uint32_t q = in_neighbor_offsets[i]; q < in_neighbor_offsets[i + 1]; q++) {
+            uint32_t from = in_neighbors[q];
+            size_t r = std::lower_bound(out_neighbors.begin() + out_neighbor_offsets[from], out_neighbors.begin() + out_neighbor_offsets[from + 1],
+                                        i) - out_neighbors.begin();
+
+            in_distance[q] = out_distance[r];
+            in_count[q] = out_count[r];
+        }
+    }
+
+    // higher scores first, then by airport_id (dense indices are in airport_id order)
+    auto better = [](const UnmetDemand &a, const UnmetDemand &b) {
+        if (a.score != b.score) return a.score > b.score;
+        if (a.first != b.first) return a.first->airport_id < b.first->airport_id;
+        return a.second->airport_id < b.second->airport_id;
+    };
+
+    threads = std::max<size_t>(1, std::min<size_t>(threads, n));
+    std::vector<std::vector<UnmetDemand>> best(threads);
+
+    // each thread scores the pairs (i, j > i) of every threads-th airport i, keeping its best top in a heap (worst on top)
+    auto work = [&](size_t t) {
+        std::vector<uint32_t> via_distance(n, UINT32_MAX);
+        std::vector<uint64_t> via_count(n, 0);
+        std::vector<uint32_t> neighbor_of(n, UINT32_MAX);
+        std::vector<UnmetDemand> &heap = best[t];
+
+        for (uint32_t i = t; i < n; i += threads) {
+            for (uint32_t q = out_neighbor_offsets[i]; q < out_neighbor_offsets[i + 1]; q++) neighbor_of[out_neighbors[q]] = i;
+            for (uint32_t q = in_neighbor_offsets[i]; q < in_neighbor_offsets[i + 1]; q++) neighbor_of[in_neighbors[q]] = i;
+
+            // i to j with one stop
+            for (uint32_t q = out_neighbor_offsets[i]; q < out_neighbor_offsets[i + 1]; q++) {
+                uint32_t stop = out_neighbors[q];
+
+                for (uint32_t r = out_neighbor_offsets[stop]; r < out_neighbor_offsets[stop + 1]; r++) {
+                    uint32_t j = out_neighbors[r];
+                    if (j <= i) continue;
+
+                    via_distance[j] = std::min(via_distance[j], out_distance[q] + out_distance[r]);
+                    via_count[j] += std::min(out_count[q], out_count[r]);
+                }
+            }
+
+            // j to i with one stop
+            for (uint32_t q = in_neighbor_offsets[i]; q < in_neighbor_offsets[i + 1]; q++) {
+                uint32_t stop = in_neighbors[q];
+
+                for (uint32_t r = in_neighbor_offsets[stop]; r < in_neighbor_offsets[stop + 1]; r++) {
+                    uint32_t j = in_neighbors[r];
+                    if (j <= i) continue;
+
+                    via_distance[j] = std::min(via_distance[j], in_distance[r] + in_distance[q]);
+                    via_count[j] += std::min(in_count[r], in_count[q]);
+                }
+            }
+
+            for (uint32_t j = i + 1; j < n; j++) {
+                if (via_distance[j] != UINT32_MAX && neighbor_of[j] != i) {
+                    double friction = 1 + via_distance[j] / 1000.0;
+
+                    UnmetDemand pair;
+                    pair.first = airports[i];
+                    pair.second = airports[j];
+                    pair.score = mass[i] * mass[j] / (friction * friction * std::log2(2.0 + via_count[j]));
+                    pair.distance = via_distance[j];
+                    pair.connections = via_count[j];
+
+                    if (heap.size() < top) {
+                        heap.push_back(pair);
+                        std::push_heap(heap.begin(), heap.end(), better);
+                    } else if (top > 0 && better(pair, heap.front())) {
+                        std::pop_heap(heap.begin(), heap.end(), better);
+                        heap.back() = pair;
+                        std::push_heap(heap.begin(), heap.end(), better);
+                    }
+                }
+
+                via_distance[j] = UINT32_MAX;
+                via_count[j] = 0;
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < threads; t++) workers.emplace_back(work, t);
+    work(0);
+
+    for (std::thread &worker : workers) worker.join();
+
+    std::vector<UnmetDemand> result;
+    for (const std::vector<UnmetDemand> &heap : best) result.insert(result.end(), heap.begin(), heap.end());
+
+    std::sort(result.begin(), result.end(), better);
+    if (result.size() > top) result.resize(top);
+
+    return result;
+}
+
+uint8_t data::FrozenGraph::stops(uint32_t from, uint32_t to) const {
+    std::vector<uint8_t> level(size(), NO_ROUTE);
+    std::vector<uint32_t> queue(1, from);
+    level[from] = 0;
+
+    for (size_t head = 0; head < queue.size() && level[to] == NO_ROUTE; head++) {
+        uint32_t current = queue[head];
+        if (level[current] + 1 >= NO_ROUTE) break;
+
+        for (uint32_t k = out_neighbor_offsets[current]; k < out_neighbor_offsets[current + 1]; k++) {
+            uint32_t next = out_neighbors[k];
+
+            if (level[next] == NO_ROUTE) {
+                level[next] = level[current] + 1;
+                queue.push_back(next);
+            }
+        }
+    }
+
+    return level[to];
+}
+
+uint32_t data::FrozenGraph::furthest(uint32_t start, std::vector<uint32_t> &found) const {
+    size_t n = size();
+
+    // visited and frontier bitmaps, one bit per airport
+    std::vector<uint64_t> visited((n + 63) / 64, 0), frontier_bits((n + 63) / 64, 0), next_bits((n + 63) / 64, 0);
+    std::vector<uint32_t> frontier(1, start), next;
+
+    visited[start / 64] |= uint64_t(1) << (start % 64);
+
+    // flights out of unvisited airports, to compare against the flights out of the frontier
+    size_t unexplored = out_neighbors.size() - (out_neighbor_offsets[start + 1] - out_neighbor_offsets[start]);
+    size_t frontier_edges = out_neighbor_offsets[start + 1] - out_neighbor_offsets[start];
+    bool bottom_up = false;
+
+    uint32_t level = 0;
+
+    while (!frontier.empty()) {
+        // switch directions as in Beamer et al.: bottom-up once the frontier has many of the remaining flights,
+        // top-down again once it has shrunk to a small share of the airports
+        if (!bottom_up && frontier_edges > unexplored / BFS_ALPHA) bottom_up = true;
+        else if (bottom_up && frontier.size() < n / BFS_BETA) bottom_up = false;
+
+        next.clear();
+
+        if (bottom_up) {
+            std::fill(frontier_bits.begin(), frontier_bits.end(), 0);
+            for (uint32_t v : frontier) frontier_bits[v / 64] |= uint64_t(1) << (v % 64);
+            std::fill(next_bits.begin(), next_bits.end(), 0);
+
+            // every unvisited airport looks for a flight in from the frontier, stopping at the first
+            for (uint32_t w = 0; w < n; w++) {
+                if (visited[w / 64] >> (w % 64) & 1) continue;
+
+                for (uint32_t k = in_neighbor_offsets[w]; k < in_neighbor_offsets[w + 1]; k++) {
+                    uint32_t v = in_neighbors[k];
+
+                    if (frontier_bits[v / 64] >> (v % 64) & 1) {
+                        next_bits[w / 64] |= uint64_t(1) << (w % 64);
+                        next.push_back(w);
+                        break;
+                    }
+                }
+            }
+
+            for (size_t i = 0; i < visited.size(); i++) visited[i] |= next_bits[i];
+        } else {
+            for (uint32_t v : frontier) {
+                for (uint32_t k = out_neighbor_offsets[v]; k < out_neighbor_offsets[v + 1]; k++) {
+                    uint32_t w = out_neighbors[k];
+
+                    if (!(visited[w / 64] >> (w % 64) & 1)) {
+                        visited[w / 64] |= uint64_t(1) << (w % 64);
+                        next.push_back(w);
+                    }
+                }
+            }
+        }
+
+        if (next.empty()) break;
+
+        frontier_edges = 0;
+        for (uint32_t w : next) frontier_edges += out_neighbor_offsets[w + 1] - out_neighbor_offsets[w];
+        unexplored -= frontier_edges;
+
+        frontier.swap(next);
+        level++;
+    }
+
+    found = frontier;
+    std::sort(found.begin(), found.end());
+
+    return level;
+}
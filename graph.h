@@ -1,8 +1,12 @@
 #pragma once
 
+#include "arena.h"
+#include "carrier.h"
+
+#include <cstdint>
+#include <deque>
 #include <iostream>
 #include <fstream>
-#include <list>
 #include <string>
 #include <utility>
 #include <vector>
@@ -10,6 +14,10 @@
 #include <unordered_set>
 #include <queue>
 
+namespace utils {
+    struct SparseMatrix;
+}
+
 namespace data {
 
     /** Stores the data for a single airport.
@@ -24,6 +32,11 @@ namespace data {
         bool operator<(const Airport &other) const { return airport_id < other.airport_id; }
     };
 
+    // Orders airport pointers by airport_id, so results do not depend on where the airports were allocated.
+    struct AirportIdLess {
+        bool operator()(const Airport *first, const Airport *second) const { return *first < *second; }
+    };
+
     /** Stores the frequency of each flight.
      */
     enum Frequency {
@@ -36,11 +49,11 @@ namespace data {
      * @param departure A pointer to the departure airport
      * @param arrival A pointer to the arrival airport
      * 
-     * @param depart_time The departure time (in seconds from midnight)
-     * @param arrive_time The arrival time (in seconds from midnight)
+     * @param depart_time The departure time (in minutes from midnight)
+     * @param arrive_time The arrival time (in minutes from midnight)
      * @param weekday The day of the flight's departure. 1 = Monday, 2 = Tuesday, ..., 7 = Sunday
      * 
-     * @param airline The airline operating the flight
+     * @param airline The airline operating the flight (see Carrier)
      * 
      * @param flight_id The unique id of the flight (procedurally generated)
      * @param distance Distance between departure and arrival points
@@ -52,11 +65,11 @@ namespace data {
         Airport *departure = NULL;
         Airport *arrival = NULL;
 
-        size_t depart_time;
-        size_t arrive_time;
-        size_t weekday;
+        size_t depart_time = 0;
+        size_t arrive_time = 0;
+        size_t weekday = 0;
 
-        std::string airline;
+        Carrier airline;
 
         size_t flight_id;
         size_t distance = 0;
@@ -72,19 +85,252 @@ namespace data {
 
     };
 
-    struct EdgeListNode {
-        EdgeListNode() = default;
-        EdgeListNode(Flight &f): flight(f) {}
+    // The flights departing and arriving at an airport, newest first. The flights themselves are kept in the graph's arena.
+    struct IncidentEdgeList {
+        Airport *airport = NULL;
+        std::deque<Flight*> departing;
+        std::deque<Flight*> arriving;
 
-        Flight flight;
-        std::list<Flight> departing;
-        std::list<Flight> arriving;
+        // The airports those flights go to and come from, each once, sorted by airport_id
+        std::vector<Airport*> destinations;
+        std::vector<Airport*> origins;
     };
 
-    struct IncidentEdgeList {
-        Airport *airport = NULL;
-        std::list<Flight> departing;
-        std::list<Flight> arriving;
+    /** A flight packed into 20 bytes, as a FrozenGraph stores it (a Flight takes about 100).
+     * @param departure, arrival Dense indices of the two airports
+     * @param depart_time, arrive_time The flight's times, as in Flight. They must be below 65536.
+     * @param distance, airtime As in Flight. They must be below 65536 too.
+     * @param carrier The airline
+     * @param weekday, frequency As in Flight
+     */
+    struct FlightRecord {
+        uint32_t departure;
+        uint32_t arrival;
+        uint16_t depart_time;
+        uint16_t arrive_time;
+        uint16_t distance;
+        uint16_t airtime;
+        Carrier carrier;
+        uint8_t weekday;
+        uint8_t frequency;
+    };
+
+    /** A pair of airports with no flight between them either way, as scored by Graph::unmetDemand.
+     * @param first, second The airports, first with the lower airport_id
+     * @param score How much demand there should be for a direct flight (higher is more)
+     * @param distance The shortest distance flown between them with one stop, either way (in miles)
+     * @param connections The one-stop itineraries between them a month, both ways
+     */
+    struct UnmetDemand {
+        Airport *first = NULL;
+        Airport *second = NULL;
+        double score = 0;
+        size_t distance = 0;
+        size_t connections = 0;
+    };
+
+    /** A flight as the Connection Scan Algorithm (CSA) sees it.
+     * @param departure, arrival Dense indices of the two airports
+     * @param depart_time, arrive_time The flight's times (in minutes from midnight)
+     * @param flight The flight's index in FrozenGraph::flights
+     */
+    struct Connection {
+        uint32_t departure;
+        uint32_t arrival;
+        uint32_t depart_time;
+        uint32_t arrive_time;
+        uint32_t flight;
+    };
+
+    /** An immutable copy of a graph in compressed sparse row (CSR) form, used to answer queries quickly.
+     * Airports get dense indices 0..n-1, ordered by airport_id, so neighbour lists come out in the same order
+     * as the unfrozen graph returns them. Each flight is stored once, as a FlightRecord:
+     * the flights departing airport i are flights[out_offsets[i]] to flights[out_offsets[i + 1] - 1],
+     * in the same order as that airport's IncidentEdgeList::departing. The queries work on the records,
+     * and only turn the flights they return back into Flights.
+     */
+    struct FrozenGraph {
+        FrozenGraph() = default;
+
+        // Throws -1 if a flight's times, distance or airtime are too large for a FlightRecord.
+        FrozenGraph(const std::unordered_map<size_t, IncidentEdgeList> &vertexList);
+
+        // Airports by dense index, and the dense index of each airport_id
+        std::vector<Airport*> airports;
+        std::unordered_map<size_t, uint32_t> airport_index;
+
+        // Flights grouped by departure airport, and the flight_id of each (kept apart, as queries rarely need it)
+        std::vector<FlightRecord> flights;
+        std::vector<size_t> ids;
+        std::vector<uint32_t> out_offsets;
+
+        // Indices into flights, grouped by departure airport like flights but sorted by depart_time within each airport
+        std::vector<uint32_t> out_by_time;
+
+        // Indices into flights, grouped by arrival airport
+        std::vector<uint32_t> in_flights;
+        std::vector<uint32_t> in_offsets;
+
+        // Distinct neighbours of each airport (dense indices, sorted)
+        std::vector<uint32_t> out_neighbors;
+        std::vector<uint32_t> out_neighbor_offsets;
+        std::vector<uint32_t> in_neighbors;
+        std::vector<uint32_t> in_neighbor_offsets;
+
+        // Which airports have a flight between them either way, one bit per pair: bit j % 64 of
+        // adjacency[i * adjacency_words + j / 64]. Only built for at most ADJACENCY_MAX_AIRPORTS airports, otherwise empty.
+        std::vector<uint64_t> adjacency;
+        size_t adjacency_words = 0;
+
+        // 8192 airports take 8MB of bits
+        static constexpr size_t ADJACENCY_MAX_AIRPORTS = 8192;
+
+        // Every flight that lands on the day it departs, sorted by depart_time and then by arrive_time
+        std::vector<Connection> connections;
+
+        // (flight_id, index into flights), sorted by flight_id
+        std::vector<std::pair<size_t, uint32_t>> flight_ids;
+
+        size_t size() const { return airports.size(); }
+
+        // Returns flights[k] as a Flight.
+        Flight flight(uint32_t k) const;
+
+        // Returns the dense index of an airport. Throws std::out_of_range if it is not in the graph.
+        uint32_t indexOf(const Airport *a) const { return airport_index.at(a->airport_id); }
+
+        // Returns the position in out_by_time of the first flight from dense index airport departing at or after time.
+        // Every flight from there up to out_offsets[airport + 1] can be caught.
+        uint32_t firstDeparture(uint32_t airport, size_t time) const;
+
+        // Returns the position in connections of the first connection departing at or after time.
+        uint32_t firstConnection(size_t time) const;
+
+        // Returns true if there is a flight from dense index first to dense index second.
+        bool hasFlight(uint32_t first, uint32_t second) const;
+
+        // Returns true if there is a flight either way between dense indices first and second.
+        // Constant time with the adjacency bits, otherwise a binary search of each neighbour list.
+        bool adjacent(uint32_t first, uint32_t second) const;
+
+        // Call visit(i, j) for each pair of dense indices i < j with no flight between them either way, in order.
+        template <typename Visit>
+        void forEachNonAdjacent(Visit visit) const;
+
+        /** Breadth-first search from every airport at once, 64 sources at a time (multi-source BFS with a
+         * 64-bit frontier per airport, one bit per source).
+         * @param eccentricity Set to the most flights needed to reach any airport reachable from each airport
+         * @param furthest Set to the airports (dense indices, sorted) that need that many flights, for each airport
+         */
+        void allEccentricities(std::vector<uint32_t> &eccentricity, std::vector<std::vector<uint32_t>> &furthest) const;
+
+        /** The fewest flights from every airport to every other, by a breadth-first search from 64 airports at a time.
+         * @param table Set to the table, row by departure: the flights from dense index i to j are at i * size() + j,
+         * and NO_ROUTE if j cannot be reached from i
+         * @param threads The number of threads to search on
+         * @throws -1 if two airports are NO_ROUTE or more flights apart
+         */
+        void stopTable(std::vector<uint8_t> &table, size_t threads) const;
+
+        // The fewest flights from dense index from to to, or NO_ROUTE if there is no route (or it needs NO_ROUTE flights or more).
+        uint8_t stops(uint32_t from, uint32_t to) const;
+
+        // The stop count in a stop table for airports with no route between them.
+        static constexpr uint8_t NO_ROUTE = 255;
+
+        /** Breadth-first search (by number of flights) from a single airport, for the airports furthest from it.
+         * Direction-optimizing: levels with a large frontier are searched bottom-up, from the unvisited airports
+         * back along their flights in, and the rest top-down.
+         * @param start Dense index of the first airport
+         * @param found Set to the furthest airports reached (dense indices, sorted)
+         * @return The number of flights needed to reach them
+         */
+        uint32_t furthest(uint32_t start, std::vector<uint32_t> &found) const;
+
+        /** Score every pair of airports that has no flight between them either way, but a route with one stop, by a gravity model:
+         * mass[i] * mass[j] / ((1 + distance / 1000)^2 * log2(2 + connections)). The distance is the shortest one-stop distance
+         * and connections counts the one-stop itineraries a month (the fewer monthly flights of the two legs, at each stop),
+         * both over either direction. Pairs more than one stop apart are not candidates.
+         * @param mass The mass of each airport (by dense index)
+         * @param top The number of pairs to return
+         * @param threads The number of threads to score on, each taking every threads-th airport
+         * @return the top pairs, highest score first (ties by airport_id)
+         */
+        std::vector<UnmetDemand> unmetDemand(const std::vector<double> &mass, size_t top, size_t threads) const;
+
+        // Thresholds for switching search direction in furthest, as suggested by Beamer et al.
+        static constexpr size_t BFS_ALPHA = 14;
+        static constexpr size_t BFS_BETA = 24;
+    };
+
+    /** How the power iteration in Graph::rankAirports converged.
+     * @param iterations The number of iterations run
+     * @param residual The 1-norm of the change in the steady state during the last iteration
+     * @param warm_start True if the iteration started from the previous ranking
+     */
+    struct RankStats {
+        size_t iterations = 0;
+        double residual = 0;
+        bool warm_start = false;
+    };
+
+    /** A PageRank (uniform personalization) that is kept up to date as flights are added, by pushing residuals.
+     * score and residual always satisfy residual = (1 - damping) v - (I - damping P) score, where P is the transition
+     * matrix (dangling airports jump uniformly) and v is uniform. Adding a flight only changes the column of P for its
+     * departure airport, so only that airport's destinations get new residuals. Pushing a residual moves it into the score
+     * and spreads damping times it to the airport's destinations, until every residual is at most tolerance.
+     */
+    struct IncrementalRank {
+        double damping = 0.85;
+        double tolerance = 1e-10;
+
+        // Threads for the full PageRank the ranking starts from
+        size_t threads = 1;
+
+        // Airports by dense index, and the dense index of each airport_id
+        std::vector<Airport*> airports;
+        std::unordered_map<size_t, uint32_t> index;
+
+        // Flights per month from each airport to each destination, and in total
+        std::vector<std::unordered_map<uint32_t, double>> routes;
+        std::vector<double> out_weight;
+
+        std::vector<double> score;
+        std::vector<double> residual;
+
+        // Total number of pushes so far
+        size_t pushes = 0;
+
+        // Add weight flights per month from dense index from to dense index to, then push the residuals that changed.
+        void addFlight(uint32_t from, uint32_t to, double weight);
+
+        // Push residuals until none is above tolerance. Only airports in changed (and airports they push to) are checked.
+        void push(const std::vector<uint32_t> &changed);
+    };
+
+    /** The furthest airports and stop count of every airport, as returned by Graph::eccentricities.
+     * @param airports Every airport, sorted by airport_id
+     * @param eccentricity The stop count of each airport (the same as Graph::stopCount)
+     * @param furthest The furthest airports from each airport (the same as Graph::findFurthestAirports)
+     * @param diameter The largest stop count
+     * @param radius The smallest stop count of an airport with at least one flight out
+     */
+    struct Eccentricities {
+        std::vector<Airport*> airports;
+        std::vector<size_t> eccentricity;
+        std::vector<std::vector<Airport*>> furthest;
+        size_t diameter = 0;
+        size_t radius = 0;
+    };
+
+    /** Options for a damped, personalized PageRank of the airports.
+     * @param damping The probability of taking another flight instead of jumping to one of the personalization airports
+     * @param personalization The airports to jump to, with weights (they do not need to add up to 1).
+     *        If empty, every airport is equally likely.
+     */
+    struct RankOptions {
+        double damping = 0.85;
+        std::vector<std::pair<Airport*, double>> personalization;
     };
 
     class Graph {
@@ -92,46 +338,314 @@ namespace data {
             // Constructor
             Graph();
 
+            // Copying makes a deep copy of every airport and flight.
             Graph(const Graph &other);
             Graph &operator=(const Graph &other);
+
+            // Moving takes over the airports and flights without copying them, and leaves other empty.
+            Graph(Graph &&other) noexcept;
+            Graph &operator=(Graph &&other) noexcept;
+
             ~Graph();
 
             Airport *getVertex(size_t id) const;
+
+            // Returns the airport with a three-letter code in O(1). Throws -1 if there is none.
             Airport *getVertex(std::string code) const;
+
+            // Look up many airport codes at once. Codes that are not in the graph give NULL instead of throwing.
+            std::vector<Airport*> getVertices(const std::vector<std::string> &codes) const;
             Flight getEdge(size_t id) const;
 
             std::vector<Airport*> getAirports() const;
             std::vector<Flight> getFlights() const;
 
-            // Create a vertex or an edge.
+            // Create a vertex or an edge. Unfreezes the graph if it is frozen.
             void createVertex(Airport* a);
             void createEdge(Flight& f);
 
-            // Returns true if there is a flight between first and second.
+            // Create a vertex for a new airport, allocated in the graph's arena.
+            Airport *createVertex(size_t id, const std::string &code);
+
+            /** Take over the airports in an arena, so they are freed with the graph. Does not create vertices for them.
+             * @param airports The arena, left empty
+             */
+            void adoptAirports(Arena<Airport> &airports);
+
+            // The number of heap blocks holding the graph's airports and unfrozen flights.
+            size_t arenaAllocations() const { return airport_arena.allocations() + flight_arena.allocations(); }
+
+            /** Freeze the graph: move the flights into a compact FrozenGraph and release the per-airport lists and their flights.
+             * Queries on a frozen graph use the FrozenGraph. The graph unfreezes itself on the next
+             * createVertex or createEdge.
+             * @throws -1 if a flight's depart_time, arrive_time, distance or airtime is 65536 or more (the graph stays unfrozen)
+             */
+            void freeze();
+            bool isFrozen() const { return is_frozen; }
+
+            // Returns true if there is a flight between first and second, in constant time on a frozen graph of up to
+            // FrozenGraph::ADJACENCY_MAX_AIRPORTS airports and by binary search otherwise.
             bool areAdjacent(Airport* first, Airport* second) const;
 
+            /** Call visit(Airport *first, Airport *second) for each pair of airports with no flight between them either way,
+             * where first has the lower airport_id, in airport_id order. An unfrozen graph is frozen into a copy for the call.
+             */
+            template <typename Visit>
+            void forEachNonAdjacentPair(Visit visit) const;
+
             // Returns all airports with a flight to arrival.
             std::vector<Airport*> incomingNodes(Airport* arrival) const;
 
             // Returns all airports with a flight from depart.
             std::vector<Airport*> outgoingNodes(Airport* depart) const;
 
-            // Find furthest airports by num connections and return the airports or the number of flights to get there
-            std::vector<Airport*> findFurthestAirports(Airport* start) const;
+            /** Call visit(const Flight &) for each flight from depart (or to arrival), newest first, without copying the lists.
+             * The flight is only valid during the call.
+             * @throws std::out_of_range if the airport is not in the graph
+             */
+            template <typename Visit>
+            void forEachDeparture(Airport *depart, Visit visit) const;
+            template <typename Visit>
+            void forEachArrival(Airport *arrival, Visit visit) const;
+
+            /** Call visit(Airport *) once for each airport with a flight from depart (or to arrival), in airport_id order.
+             * Reads the graph's own neighbour lists, so it does not allocate.
+             * @throws std::out_of_range if the airport is not in the graph
+             */
+            template <typename Visit>
+            void forEachDestination(Airport *depart, Visit visit) const;
+            template <typename Visit>
+            void forEachOrigin(Airport *arrival, Visit visit) const;
+
+            // Find furthest airports by num connections (sorted by airport_id) and the number of flights to get there, in one search
+            std::vector<Airport*> findFurthestAirports(Airport* start, size_t *stops = NULL) const;
             size_t stopCount(Airport *start) const;
 
+            // Find furthest airports and the stop count of every airport at once, 64 airports per breadth-first search.
+            Eccentricities eccentricities() const;
+
+            /** Find the airport pairs most in need of a direct flight: pairs with no flight either way but a route with one stop,
+             * scored by FrozenGraph::unmetDemand with PageRank scores (scaled so the average airport is 1) as masses.
+             * An unfrozen graph is frozen into a copy for the call.
+             * @param top The number of pairs to return
+             * @param threads The number of threads to rank and score on
+             * @return the top pairs, highest score first
+             */
+            std::vector<UnmetDemand> unmetDemand(size_t top = 10, size_t threads = 1) const;
+
+            /** The fewest flights from depart to arrive. Answered from the stop table in constant time if there is one,
+             * otherwise by a breadth-first search from depart.
+             * @throws -1 if there is no route
+             */
+            size_t stops(Airport *depart, Airport *arrive) const;
+
+            /** Compute the fewest flights between every pair of airports (one byte per pair), so stops answers in constant time.
+             * Freezes the graph. The table is dropped on the next createVertex or createEdge.
+             * @param threads The number of threads to compute it on
+             * @throws -1 if two airports are 255 or more flights apart
+             */
+            void computeStopTable(size_t threads = 1);
+            bool hasStopTable() const { return !stop_table.empty(); }
+
+            // The stop table, by departure then arrival in airport_id order (see FrozenGraph::stopTable). Empty if there is none.
+            const std::vector<uint8_t> &getStopTable() const { return stop_table; }
+
+            /** Use a stop table computed earlier for the same airports and flights, such as one saved in a snapshot.
+             * Freezes the graph.
+             * @throws -1 if the table is the wrong size
+             */
+            void setStopTable(std::vector<uint8_t> table);
+
             // Find shortest path (using min of arrival time) from A to B.
             // May occasionally return path not found when a path exists
             std::vector<Flight> shortestPath(Airport *depart, Airport* arrive, size_t departTime=0, size_t minConnectionTime=0) const;
             
-            // Returns a sorted vector of airports by importance. Uses Markov chains on outgoing flights.
-            std::vector<Airport*> rankAirports() const;
+            /** Find the itinerary from depart to arrive that lands earliest, using the Connection Scan Algorithm.
+             * Unlike shortestPath, this always finds an itinerary when one exists. Overnight flights are not used.
+             * The connection time is not needed for the first flight.
+             * @throws -1 if there is no same day itinerary.
+             */
+            std::vector<Flight> earliestArrival(Airport *depart, Airport* arrive, size_t departTime=0, size_t minConnectionTime=0) const;
+
+            /** Find the earliest arrival at arrive for every departure time from depart, in one reverse pass over the connections.
+             * Returns the Pareto set: each itinerary leaves later than the one before it and arrives later too.
+             * Leaving at time t, the best itinerary is the first one that departs at or after t (the same one earliestArrival finds).
+             * @return the itineraries, sorted by departure time. Empty if there is no same day itinerary.
+             * @throws -1 if either airport is not in the graph.
+             */
+            std::vector<std::vector<Flight>> profile(Airport *depart, Airport* arrive, size_t minConnectionTime=0) const;
+
+            /** Returns airports and their scores sorted by importance (ties by airport_id). Uses Markov chains on outgoing flights.
+             * The transition matrix is sparse (one entry per route), and power iteration stops once it converges.
+             * @param top Only return the top airports. Only those are sorted.
+             * @param stats If not NULL, set to the number of iterations run and the final residual.
+             * @param threads The number of threads to run power iteration on
+             */
+            std::vector<std::pair<Airport*, double>> rankAirports(size_t top = SIZE_MAX, RankStats *stats = NULL, size_t threads = 1) const;
+
+            /** Returns airports and their scores sorted by damped, personalized PageRank (ties by airport_id).
+             * Airports with no departures jump to the personalization airports. Starts from the result of the previous call
+             * if the airports have not changed, so repeated queries converge in a few iterations.
+             * @param top Only return the top airports. Only those are sorted.
+             * @param threads The number of threads to run power iteration on
+             * @throws -1 if a personalization airport is not in the graph or the options are invalid.
+             */
+            std::vector<std::pair<Airport*, double>> rankAirports(const RankOptions &options, size_t top = SIZE_MAX, RankStats *stats = NULL,
+                                                                  size_t threads = 1) const;
+
+            /** Start keeping a PageRank (uniform personalization) up to date as flights are added with createEdge.
+             * Each new flight then only costs time for the airports its change reaches, instead of a whole new ranking.
+             * Adding an airport (or a flight to an airport the ranking has not seen) starts the ranking over, on the same threads.
+             * @param threads The number of threads to run the full rankings on
+             */
+            void trackRanking(double damping = 0.85, size_t threads = 1);
+            bool isTrackingRanking() const { return is_tracking; }
+
+            /** Returns the tracked PageRank, like rankAirports.
+             * @param stats If not NULL, iterations is set to the number of pushes so far and residual to the largest residual.
+             * @throws -1 if trackRanking has not been called.
+             */
+            std::vector<std::pair<Airport*, double>> trackedRanking(size_t top = SIZE_MAX, RankStats *stats = NULL) const;
+
+            // Returns the airports an airline departs from, weighted by its flights per month from each one.
+            std::vector<std::pair<Airport*, double>> airlineHubs(const std::string &airline) const;
+
+            // Returns the number of flights an airline operates in the graph, in constant time.
+            size_t flightCount(Carrier airline) const { return airline.id() < carrier_flights.size() ? carrier_flights[airline.id()] : 0; }
             
         private:
             void copy(const Graph &other);
             void clear();
+
+            // Exchange everything with other, including the frozen graph and ranking state.
+            void swap(Graph &other) noexcept;
+
+            // Rebuild the per-airport lists from the frozen graph.
+            void thaw();
+
+            // Build the column-stochastic transition matrix used to rank airports (rows and columns in the order of airports).
+            utils::SparseMatrix transitionMatrix(const std::vector<Airport*> &airports) const;
+
             std::unordered_map<size_t, IncidentEdgeList> vertexList;
-            std::unordered_map<size_t, EdgeListNode> edgeList;
+            std::unordered_map<size_t, Flight*> edgeList;
+
+            // Airports created by the graph (the rest were allocated with new), and the flights of an unfrozen graph.
+            // Each is freed in one go: the airports with the graph, the flights when it is frozen.
+            Arena<Airport> airport_arena;
+            Arena<Flight> flight_arena;
+
+            // Airports by code, filled in by createVertex. Codes of three capital letters index code_table directly
+            // (26 * 26 * 26 slots), any other code goes in other_codes.
+            std::vector<Airport*> code_table;
+            std::unordered_map<std::string, Airport*> other_codes;
+
+            FrozenGraph frozen;
+            bool is_frozen = false;
+
+            // Fewest flights between every pair of frozen airports, see computeStopTable
+            std::vector<uint8_t> stop_table;
+
+            // Flights per airline, by Carrier::id
+            std::vector<size_t> carrier_flights;
+
+            IncrementalRank tracked_rank;
+            bool is_tracking = false;
+
+            // The airports and steady state of the last PageRank, used to warm start the next one
+            mutable std::vector<Airport*> rank_airports;
+            mutable std::vector<double> rank_state;
     };
 
+    template <typename Visit>
+    void FrozenGraph::forEachNonAdjacent(Visit visit) const {
+        uint32_t n = size();
+
+        for (uint32_t i = 0; i < n; i++) {
+            if (!adjacency.empty()) {
+                // the clear bits of row i after column i, word by word
+                const uint64_t *row = adjacency.data() + i * adjacency_words;
+
+                for (size_t w = (i + 1) / 64; w < adjacency_words; w++) {
+                    uint64_t missing = ~row[w];
+                    if (w == (i + 1) / 64) missing &= ~uint64_t(0) << ((i + 1) % 64);
+                    if (w == adjacency_words - 1 && n % 64 != 0) missing &= (uint64_t(1) << (n % 64)) - 1;
+
+                    for (; missing != 0; missing &= missing - 1) visit(i, uint32_t(w * 64 + __builtin_ctzll(missing)));
+                }
+
+                continue;
+            }
+
+            // walk both sorted neighbour lists alongside j
+            const uint32_t *out = out_neighbors.data() + out_neighbor_offsets[i];
+            const uint32_t *out_end = out_neighbors.data() + out_neighbor_offsets[i + 1];
+            const uint32_t *in = in_neighbors.data() + in_neighbor_offsets[i];
+            const uint32_t *in_end = in_neighbors.data() + in_neighbor_offsets[i + 1];
+
+            for (uint32_t j = i + 1; j < n; j++) {
+                while (out != out_end && *out < j) out++;
+                while (in != in_end && *in < j) in++;
+
+                if ((out == out_end || *out != j) && (in == in_end || *in != j)) visit(i, j);
+            }
+        }
+    }
+
+    template <typename Visit>
+    void Graph::forEachNonAdjacentPair(Visit visit) const {
+        FrozenGraph built;
+        if (!is_frozen) built = FrozenGraph(vertexList);
+        const FrozenGraph &g = is_frozen ? frozen : built;
+
+        g.forEachNonAdjacent([&g, &visit](uint32_t i, uint32_t j) { visit(g.airports[i], g.airports[j]); });
+    }
+
+    template <typename Visit>
+    void Graph::forEachDeparture(Airport *depart, Visit visit) const {
+        if (is_frozen) {
+            uint32_t i = frozen.indexOf(depart);
+            for (uint32_t k = frozen.out_offsets[i]; k < frozen.out_offsets[i + 1]; k++) visit(frozen.flight(k));
+            return;
+        }
+
+        for (const Flight *f : vertexList.at(depart->airport_id).departing) visit(*f);
+    }
+
+    template <typename Visit>
+    void Graph::forEachArrival(Airport *arrival, Visit visit) const {
+        if (is_frozen) {
+            uint32_t i = frozen.indexOf(arrival);
+            for (uint32_t k = frozen.in_offsets[i]; k < frozen.in_offsets[i + 1]; k++) visit(frozen.flight(frozen.in_flights[k]));
+            return;
+        }
+
+        for (const Flight *f : vertexList.at(arrival->airport_id).arriving) visit(*f);
+    }
+
+    template <typename Visit>
+    void Graph::forEachDestination(Airport *depart, Visit visit) const {
+        if (is_frozen) {
+            uint32_t i = frozen.indexOf(depart);
+            for (uint32_t k = frozen.out_neighbor_offsets[i]; k < frozen.out_neighbor_offsets[i + 1]; k++) {
+                visit(frozen.airports[frozen.out_neighbors[k]]);
+            }
+            return;
+        }
+
+        for (Airport *a : vertexList.at(depart->airport_id).destinations) visit(a);
+    }
+
+    template <typename Visit>
+    void Graph::forEachOrigin(Airport *arrival, Visit visit) const {
+        if (is_frozen) {
+            uint32_t i = frozen.indexOf(arrival);
+            for (uint32_t k = frozen.in_neighbor_offsets[i]; k < frozen.in_neighbor_offsets[i + 1]; k++) {
+                visit(frozen.airports[frozen.in_neighbors[k]]);
+            }
+            return;
+        }
+
+        for (Airport *a : vertexList.at(arrival->airport_id).origins) visit(a);
+    }
+
 }
@@ -1,17 +1,35 @@
 #include "graph.h"
 #include "loadfile.h"
+#include "scan.h"
 #include "utils.h"
 
+#include <algorithm>
+#include <chrono>
+#include <exception>
 #include <fstream>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 using data::Graph;
 using data::Airport;
 using data::Flight;
+using io::FlightRow;
+
+// The first line of every BTS file we can read.
+static const std::string_view HEADER = R"("DAY_OF_WEEK","FL_DATE","OP_UNIQUE_CARRIER","ORIGIN_AIRPORT_ID","ORIGIN","DEST_AIRPORT_ID","DEST","CRS_DEP_TIME","CRS_ARR_TIME","AIR_TIME","DISTANCE",)";
 
 std::map<std::pair<Airport*, Airport*>, std::vector<Flight>> io::mergeFlights(
     std::map<std::pair<Airport*, Airport*>, std::vector<Flight>> &flights,
@@ -78,6 +96,91 @@ std::map<std::pair<Airport*, Airport*>, std::vector<Flight>> io::mergeFlights(
 
 }
 
+/** Key used to bucket the flights of one route in mergeSchedules.
+ * Flights with the same key are similar (see Flight::isSimilar), and on the same weekday unless weekday is ignored.
+ */
+struct ScheduleKey {
+    data::Carrier airline;
+    size_t depart_time;
+    size_t weekday;
+
+    bool operator==(const ScheduleKey &other) const {
+        return airline == other.airline && depart_time == other.depart_time && weekday == other.weekday;
+    }
+};
+
+struct ScheduleKeyHash {
+    size_t operator()(const ScheduleKey &key) const {
+        return key.airline.id() ^ (key.depart_time * 31 + key.weekday) * 0x9e3779b97f4a7c15ull;
+    }
+};
+
+std::map<std::pair<Airport*, Airport*>, std::vector<Flight>> io::mergeSchedules(
+    const std::map<std::pair<Airport*, Airport*>, std::vector<Flight>> &flights,
+    size_t weeklyThreshold, size_t dailyThreshold) {
+
+    std::map<std::pair<Airport*, Airport*>, std::vector<Flight>> merged;
+
+    // Weekly flights on a route, and per similar-flight bucket: how many weekly flights it has,
+    // how many of them we've passed, and whether a similar flight has been kept yet.
+    std::vector<Flight> weekly;
+    std::unordered_map<ScheduleKey, size_t, ScheduleKeyHash> counts;
+    std::unordered_map<ScheduleKey, size_t, ScheduleKeyHash> seen;
+    std::unordered_set<ScheduleKey, ScheduleKeyHash> kept;
+
+    for (auto i = flights.begin(); i != flights.end(); i++) {
+        const std::vector<Flight> &monthly = i->second;
+        if (monthly.empty()) continue;
+
+        // Monthly -> weekly: count similar flights per weekday, and keep the first of each bucket
+        // that reaches the threshold (the rest of the bucket are duplicates of it).
+        counts.clear();
+        for (const Flight &f : monthly) counts[ScheduleKey{f.airline, f.depart_time, f.weekday}]++;
+
+        weekly.clear();
+        seen.clear();
+        for (const Flight &f : monthly) {
+            ScheduleKey key{f.airline, f.depart_time, f.weekday};
+
+            if (counts[key] < weeklyThreshold) {
+                weekly.push_back(f);
+            } else if (seen[key]++ == 0) {
+                weekly.push_back(f);
+                weekly.back().frequency = data::WEEKLY;
+            }
+        }
+
+        // Weekly -> daily: bucket similar flights regardless of weekday.
+        // mergeFlights promotes a weekly flight while the bucket still has at least dailyThreshold weekly
+        // flights (flights it already promoted no longer count), and keeps a promoted flight only if no
+        // similar flight has been kept before it.
+        counts.clear();
+        for (const Flight &f : weekly) {
+            if (f.frequency == data::WEEKLY) counts[ScheduleKey{f.airline, f.depart_time, 0}]++;
+        }
+
+        seen.clear();
+        kept.clear();
+        std::vector<Flight> &out = merged[i->first];
+
+        for (const Flight &f : weekly) {
+            ScheduleKey key{f.airline, f.depart_time, 0};
+
+            if (f.frequency == data::WEEKLY && counts[key] - seen[key]++ >= dailyThreshold) {
+                if (kept.insert(key).second) {
+                    out.push_back(f);
+                    out.back().frequency = data::DAILY;
+                }
+            } else {
+                out.push_back(f);
+                kept.insert(key);
+            }
+        }
+    }
+
+    return merged;
+}
+
 std::ifstream io::openFile(const std::string &filepath) {
     if (filepath.size() <= 4) {
         std::cerr << "File is not a CSV. Please try again." << std::endl;
@@ -102,11 +205,11 @@ std::ifstream io::openFile(const std::string &filepath) {
     return file;
 }
 
-Graph* io::loadFile(const std::string &filepath) {
+std::unique_ptr<Graph> io::loadFile(const std::string &filepath) {
     try {
         // checking for valid file (with try/catch block)
         std::ifstream file = openFile(filepath);
-        Graph* g = loadFile(file);
+        std::unique_ptr<Graph> g = loadFile(file);
         file.close();
         return g;
     } catch (int i) {
@@ -115,11 +218,11 @@ Graph* io::loadFile(const std::string &filepath) {
     }
 }
 
-Graph* io::loadFile(std::ifstream &file) {
+std::unique_ptr<Graph> io::loadFile(std::ifstream &file) {
     std::string first_line;
     getline(file, first_line);
 
-    if (first_line != R"("DAY_OF_WEEK","FL_DATE","OP_UNIQUE_CARRIER","ORIGIN_AIRPORT_ID","ORIGIN","DEST_AIRPORT_ID","DEST","CRS_DEP_TIME","CRS_ARR_TIME","AIR_TIME","DISTANCE",)") {
+    if (first_line != HEADER) {
         std::cerr << "File formatting is incorrect. Please try again with correctly formatted file." << std::endl;
         throw -3;
     }
@@ -127,8 +230,9 @@ Graph* io::loadFile(std::ifstream &file) {
     // map depart, arrive pair to a vector of flights from A to B
     std::map<std::pair<Airport*, Airport*>, std::vector<Flight>> flights;
 
-    // map airport code to airport
+    // map airport code to airport, and the arena they are created in
     std::map<size_t, Airport*> airports;
+    data::Arena<Airport> arena;
 
     std::string line;
     size_t flight_count = 0;
@@ -138,69 +242,301 @@ Graph* io::loadFile(std::ifstream &file) {
     while (file) {
         getline(file, line);
         line_count++; 
-        
-        std::vector<std::string> fields = utils::split(line, ',');
-
-        if (fields[0] == "" ||
-            fields[1] == "" ||
-            fields[3] == "" ||
-            fields[5] == "" ||
-            fields[7] == "" ||
-            fields[8] == "") continue;       
-
-        // initialize every single flight
-        // flight_id (auto increment) & weekday & airline carrier
-        Flight curr;
-        curr.flight_id = flight_count++;
-        curr.weekday = std::stoi(fields[0]);
-        curr.airline = fields[2].substr(1, fields[2].size() - 2);
-        
-        // departure airport (initialize new airport if necessary)
-        if (airports.find(std::stoi(fields[3])) == airports.end()) {
-            Airport *a = new Airport();
 
-            a -> airport_id = std::stoi(fields[3]);
-            a -> airport_code = fields[4].substr(1, 3);
+        FlightRow row;
+        if (parseRow(line, row)) addRow(row, arena, airports, flights, flight_count);
+    }
 
-            curr.departure = a;
+    return buildGraph(arena, airports, flights, line_count);
+}
 
-            airports[std::stoi(fields[3])] = a;
-        } else {
-            curr.departure = airports[std::stoi(fields[3])];
-        }
+std::unique_ptr<Graph> io::loadFileMapped(const std::string &filepath, size_t threads) {
+    // reuse the same checks (and error codes) as the stream loader
+    openFile(filepath).close();
 
-        // arrival airport (initialize new airport if necessary)
-        if (airports.find(std::stoi(fields[5])) == airports.end()) {
-            Airport *a = new Airport();
+    auto start = std::chrono::steady_clock::now();
 
-            a -> airport_id = std::stoi(fields[5]);
-            a -> airport_code = fields[6].substr(1, 3);
+    MappedFile file(filepath);
+    std::string_view contents = file.view();
 
-            curr.arrival = a;
+    size_t line_end = contents.find('\n');
+    if (contents.substr(0, line_end) != HEADER) {
+        std::cerr << "File formatting is incorrect. Please try again with correctly formatted file." << std::endl;
+        throw -3;
+    }
+
+    std::string_view body = line_end == std::string_view::npos ? std::string_view() : contents.substr(line_end + 1);
 
-            airports[std::stoi(fields[5])] = a;
-        } else {
-            curr.arrival = airports[std::stoi(fields[5])];
+    if (threads == 0) threads = 1;
+
+    // cut the body into newline-aligned chunks of roughly equal size
+    std::vector<std::string_view> chunks;
+    size_t chunk_start = 0;
+
+    for (size_t i = 1; i <= threads && chunk_start < body.size(); i++) {
+        size_t chunk_end = body.size();
+
+        if (i < threads) {
+            chunk_end = body.find('\n', std::max(chunk_start, body.size() * i / threads));
+            chunk_end = chunk_end == std::string_view::npos ? body.size() : chunk_end + 1;
         }
 
-        // departure/arrival time
-        curr.depart_time = utils::timeFromMidnight(fields[7]);
-        curr.arrive_time = utils::timeFromMidnight(fields[8]);
+        chunks.push_back(body.substr(chunk_start, chunk_end - chunk_start));
+        chunk_start = chunk_end;
+    }
+
+    // parse the chunks in parallel (the calling thread takes the first one)
+    std::vector<ParsedChunk> parsed(chunks.size());
+    std::vector<std::exception_ptr> errors(chunks.size());
+    std::vector<std::thread> workers;
+
+    // a row the stream loader would throw on is rethrown here, from the first chunk that has one
+    auto parse = [&](size_t i) {
+        try {
+            parseChunk(chunks[i], parsed[i]);
+        } catch (...) {
+            errors[i] = std::current_exception();
+        }
+    };
+
+    for (size_t i = 1; i < chunks.size(); i++) {
+        workers.emplace_back(parse, i);
+    }
+    if (!chunks.empty()) parse(0);
+
+    for (std::thread &worker : workers) worker.join();
+    for (std::exception_ptr &error : errors) {
+        if (error) std::rethrow_exception(error);
+    }
+
+    // map depart, arrive pair to a vector of flights from A to B
+    std::map<std::pair<Airport*, Airport*>, std::vector<Flight>> flights;
+
+    // map airport code to airport, and the arena they are created in
+    std::map<size_t, Airport*> airports;
+    data::Arena<Airport> arena;
+
+    size_t flight_count = 0;
+    size_t line_count = 0;
+
+    // merge in file order so flight ids are the same as a single-threaded load
+    for (ParsedChunk &chunk : parsed) {
+        mergeChunk(chunk, arena, airports, flights, flight_count);
+        line_count += chunk.line_count;
+    }
+
+    // getline also reads the empty line after a trailing newline
+    if (body.empty() || body.back() == '\n') line_count++;
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Parsed " << contents.size() << " bytes (" << line_count << " rows) on " << chunks.size() << " thread(s) in " << seconds << "s: "
+              << contents.size() / seconds / 1e6 << " MB/s, " << line_count / seconds << " rows/s" << std::endl;
+
+    return buildGraph(arena, airports, flights, line_count);
+}
+
+void io::parseChunk(std::string_view chunk, ParsedChunk &out) {
+    // map airport id to its index in out.airports
+    std::unordered_map<size_t, uint32_t> local_index;
+
+    // carriers seen in this chunk, so the shared dictionary is only locked once per carrier per chunk
+    std::unordered_map<std::string_view, data::Carrier> local_carriers;
 
-        // flight time & distance 
-        if (fields[9] != "") curr.airtime = std::stoi(fields[9]);
-        if (fields[10] != "") curr.distance = std::stoi(fields[10]);
+    auto resolve = [&](size_t id, std::string_view code) {
+        auto found = local_index.find(id);
+        if (found != local_index.end()) return found->second;
 
-        // set Monthly frequency as default
+        uint32_t idx = out.airports.size();
+        local_index[id] = idx;
+        out.airports.push_back(std::pair<size_t, std::string_view>(id, code));
+        return idx;
+    };
+
+    size_t pos = 0;
+
+    while (pos < chunk.size()) {
+        // find the fields and the end of the line in a single pass
+        std::string_view fields[11];
+        size_t consumed;
+        size_t count = utils::splitFields(chunk.substr(pos), fields, 11, consumed);
+
+        out.line_count++;
+        pos += consumed;
+
+        FlightRow row;
+        if (!parseFields(fields, count, row)) continue;
+
+        Flight curr;
+        curr.weekday = row.weekday;
+        auto carrier = local_carriers.find(row.airline);
+        if (carrier == local_carriers.end()) carrier = local_carriers.insert(std::make_pair(row.airline, data::Carrier(row.airline))).first;
+
+        curr.airline = carrier->second;
+        curr.depart_time = row.depart_time;
+        curr.arrive_time = row.arrive_time;
+        curr.airtime = row.airtime;
+        curr.distance = row.distance;
         curr.frequency = data::MONTHLY;
 
-        // map each single flight to the corresponding pair of departure/arrival airports
-        if (flights.find(std::pair<Airport*, Airport*>(curr.departure, curr.arrival)) == flights.end()) {
-            flights[std::pair<Airport*, Airport*>(curr.departure, curr.arrival)] = std::vector<Flight>();
+        // resolve the departure first, as addRow creates it first
+        uint32_t departure = resolve(row.origin_id, row.origin_code);
+        uint32_t arrival = resolve(row.dest_id, row.dest_code);
+
+        out.flights.push_back(curr);
+        out.endpoints.push_back(std::pair<uint32_t, uint32_t>(departure, arrival));
+    }
+}
+
+void io::mergeChunk(ParsedChunk &chunk, data::Arena<Airport> &arena, std::map<size_t, Airport*> &airports,
+    std::map<std::pair<Airport*, Airport*>, std::vector<Flight>> &flights, size_t &flight_count) {
+
+    // translate the chunk's airport table, keeping the code from the earliest chunk that saw the airport
+    std::vector<Airport*> global(chunk.airports.size());
+
+    for (size_t i = 0; i < chunk.airports.size(); i++) {
+        Airport *&a = airports[chunk.airports[i].first];
+
+        if (a == NULL) {
+            a = arena.create();
+            a -> airport_id = chunk.airports[i].first;
+            a -> airport_code = std::string(chunk.airports[i].second);
+        }
+
+        global[i] = a;
+    }
+
+    for (size_t i = 0; i < chunk.flights.size(); i++) {
+        Flight &curr = chunk.flights[i];
+
+        curr.flight_id = flight_count++;
+        curr.departure = global[chunk.endpoints[i].first];
+        curr.arrival = global[chunk.endpoints[i].second];
+
+        flights[std::pair<Airport*, Airport*>(curr.departure, curr.arrival)].push_back(std::move(curr));
+    }
+
+    chunk.flights.clear();
+    chunk.endpoints.clear();
+}
+
+io::MappedFile::MappedFile(const std::string &filepath) {
+    int fd = open(filepath.c_str(), O_RDONLY);
+
+    if (fd < 0) {
+        std::cerr << "Invalid filepath. Please try again with a valid file." << std::endl;
+        throw -1;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        std::cerr << "Invalid filepath. Please try again with a valid file." << std::endl;
+        throw -1;
+    }
+
+    length = info.st_size;
+
+    // mmap cannot map an empty file, leave the view empty instead
+    if (length > 0) {
+        void *mapping = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (mapping == MAP_FAILED) {
+            close(fd);
+            std::cerr << "File could not be mapped into memory." << std::endl;
+            throw -1;
         }
-        flights[std::pair<Airport*, Airport*>(curr.departure, curr.arrival)].push_back(curr);
 
+        madvise(mapping, length, MADV_SEQUENTIAL);
+        bytes = static_cast<const char*>(mapping);
+    }
+
+    close(fd);
+}
+
+io::MappedFile::~MappedFile() {
+    if (bytes != NULL) munmap(const_cast<char*>(bytes), length);
+}
+
+bool io::parseRow(std::string_view line, FlightRow &row) {
+    std::string_view fields[11];
+    size_t consumed;
+
+    return parseFields(fields, utils::splitFields(line, fields, 11, consumed), row);
+}
+
+bool io::parseFields(const std::string_view *fields, size_t count, FlightRow &row) {
+    if (count < 11) return false;
+
+    if (fields[0] == "" ||
+        fields[1] == "" ||
+        fields[3] == "" ||
+        fields[5] == "" ||
+        fields[7] == "" ||
+        fields[8] == "") return false;
+
+    // weekday & airline carrier (strip the quotes)
+    row.weekday = utils::parseInt(fields[0]);
+    row.airline = fields[2].substr(1, fields[2].size() - 2);
+
+    // departure/arrival airports
+    row.origin_id = utils::parseInt(fields[3]);
+    row.origin_code = fields[4].substr(1, 3);
+    row.dest_id = utils::parseInt(fields[5]);
+    row.dest_code = fields[6].substr(1, 3);
+
+    // departure/arrival time
+    row.depart_time = utils::timeFromMidnight(fields[7]);
+    row.arrive_time = utils::timeFromMidnight(fields[8]);
+
+    // flight time & distance 
+    if (fields[9] != "") row.airtime = utils::parseInt(fields[9]);
+    if (fields[10] != "") row.distance = utils::parseInt(fields[10]);
+
+    return true;
+}
+
+void io::addRow(const FlightRow &row, data::Arena<Airport> &arena, std::map<size_t, Airport*> &airports,
+    std::map<std::pair<Airport*, Airport*>, std::vector<Flight>> &flights, size_t &flight_count) {
+
+    // initialize every single flight
+    // flight_id (auto increment) & weekday & airline carrier
+    Flight curr;
+    curr.flight_id = flight_count++;
+    curr.weekday = row.weekday;
+    curr.airline = data::Carrier(row.airline);
+
+    // departure airport (initialize new airport if necessary)
+    Airport *&departure = airports[row.origin_id];
+    if (departure == NULL) {
+        departure = arena.create();
+        departure -> airport_id = row.origin_id;
+        departure -> airport_code = std::string(row.origin_code);
+    }
+    curr.departure = departure;
+
+    // arrival airport (initialize new airport if necessary)
+    Airport *&arrival = airports[row.dest_id];
+    if (arrival == NULL) {
+        arrival = arena.create();
+        arrival -> airport_id = row.dest_id;
+        arrival -> airport_code = std::string(row.dest_code);
     }
+    curr.arrival = arrival;
+
+    curr.depart_time = row.depart_time;
+    curr.arrive_time = row.arrive_time;
+    curr.airtime = row.airtime;
+    curr.distance = row.distance;
+
+    // set Monthly frequency as default
+    curr.frequency = data::MONTHLY;
+
+    // map each single flight to the corresponding pair of departure/arrival airports
+    flights[std::pair<Airport*, Airport*>(curr.departure, curr.arrival)].push_back(curr);
+}
+
+std::unique_ptr<Graph> io::buildGraph(data::Arena<Airport> &arena, std::map<size_t, Airport*> &airports,
+    std::map<std::pair<Airport*, Airport*>, std::vector<Flight>> &flights, size_t line_count) {
 
     // flights summary statistics: total number of valid flights 
     size_t valid_flights = 0;
@@ -212,8 +548,7 @@ Graph* io::loadFile(std::ifstream &file) {
     std::cout << "Total valid flights: " << valid_flights << " (" << (double) 100* valid_flights / line_count << "%)" << std::endl;
 
     // update curr.frequency;
-    flights = mergeFlights(flights, data::WEEKLY, 3);
-    flights = mergeFlights(flights, data::DAILY, 6);
+    flights = mergeSchedules(flights, 3, 6);
 
     valid_flights = 0;
     for (auto i = flights.begin(); i != flights.end(); i++) {
@@ -224,7 +559,8 @@ Graph* io::loadFile(std::ifstream &file) {
     std::cout << "Airports detected: " << airports.size() << std::endl;
 
     // initialize the airline multigraph with airports as vertex and each single flight as a single edge
-    Graph* g = new Graph();
+    std::unique_ptr<Graph> g(new Graph());
+    g->adoptAirports(arena);
 
     for (auto i = airports.begin(); i != airports.end(); i++) {
         g->createVertex(i -> second);
@@ -236,6 +572,11 @@ Graph* io::loadFile(std::ifstream &file) {
         }
     }
 
+    std::cout << "Stored " << airports.size() << " airports and " << valid_flights << " flights in "
+              << g->arenaAllocations() << " allocations." << std::endl;
+
+    g->freeze();
+
     std::cout << "Finished loading." << std::endl;
 
     return g;
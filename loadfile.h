@@ -2,8 +2,12 @@
 
 #include "graph.h"
 
+#include <cstdint>
 #include <fstream>
 #include <map>
+#include <memory>
+#include <string>
+#include <string_view>
 #include <vector>
 
 using data::Airport;
@@ -11,6 +15,118 @@ using data::Flight;
 
 namespace io {
 
+    /** A read-only memory mapping of an entire file.
+     * The mapping is released when the object is destroyed.
+     */
+    class MappedFile {
+        public:
+            /** Map a file into memory.
+             * @param filepath The filepath
+             * @throws -1 if the file cannot be opened or mapped
+             */
+            explicit MappedFile(const std::string &filepath);
+            ~MappedFile();
+
+            MappedFile(const MappedFile &other) = delete;
+            MappedFile &operator=(const MappedFile &other) = delete;
+
+            const char *data() const { return bytes; }
+            size_t size() const { return length; }
+
+            // The whole file as a view. Valid for the lifetime of the mapping.
+            std::string_view view() const { return std::string_view(bytes, length); }
+
+        private:
+            const char *bytes = NULL;
+            size_t length = 0;
+    };
+
+    /** A single row of a BTS file, parsed but not yet attached to any airport.
+     * The string fields point into the line that was parsed, so the row is only valid while that line is.
+     */
+    struct FlightRow {
+        size_t weekday;
+        std::string_view airline;
+
+        size_t origin_id;
+        std::string_view origin_code;
+        size_t dest_id;
+        std::string_view dest_code;
+
+        size_t depart_time;
+        size_t arrive_time;
+        size_t airtime = 0;
+        size_t distance = 0;
+    };
+
+    /** The flights and airports parsed from one chunk of a file by a single worker thread.
+     * Airports are kept in a table local to the chunk, and flights refer to them by local index
+     * until the chunk is merged.
+     */
+    struct ParsedChunk {
+        // (airport id, airport code) in the order the airports were first seen in the chunk
+        std::vector<std::pair<size_t, std::string_view>> airports;
+
+        // Flights without departure, arrival or flight_id set, and their (departure, arrival) local airport indices
+        std::vector<Flight> flights;
+        std::vector<std::pair<uint32_t, uint32_t>> endpoints;
+
+        size_t line_count = 0;
+    };
+
+    /** Parse every line of a chunk. The chunk must start at the beginning of a line.
+     * @param chunk The text to parse. Views in the result point into it.
+     * @param out The chunk to fill in
+     */
+    void parseChunk(std::string_view chunk, ParsedChunk &out);
+
+    /** Merge a parsed chunk into the staging maps. Chunks must be merged in file order.
+     * @param chunk The parsed chunk
+     * @param arena Where new airports are created
+     * @param airports Map of airport id to airport. New airports are created as needed.
+     * @param flights Map of (departure, arrival) to flights between them
+     * @param flight_count The next flight id to use. Incremented once per flight.
+     */
+    void mergeChunk(ParsedChunk &chunk, data::Arena<Airport> &arena, std::map<size_t, Airport*> &airports,
+        std::map<std::pair<Airport*, Airport*>, std::vector<Flight>> &flights, size_t &flight_count);
+
+    /** Parse a single line of a BTS file (without its newline).
+     * @param line The line to parse
+     * @param row The row to fill in
+     * @return false if the line is missing a required field and should be skipped
+     */
+    bool parseRow(std::string_view line, FlightRow &row);
+
+    /** Parse the fields of a single line of a BTS file.
+     * @param fields The first 11 fields of the line
+     * @param count The number of fields in the line
+     * @param row The row to fill in
+     * @return false if the line is missing a required field and should be skipped
+     */
+    bool parseFields(const std::string_view *fields, size_t count, FlightRow &row);
+
+    /** Turn a parsed row into a monthly flight and add it to the staging maps.
+     * New airports are created as they are first seen.
+     * @param row The parsed row
+     * @param arena Where new airports are created
+     * @param airports Map of airport id to airport
+     * @param flights Map of (departure, arrival) to flights between them
+     * @param flight_count The next flight id to use. Incremented by one.
+     */
+    void addRow(const FlightRow &row, data::Arena<Airport> &arena, std::map<size_t, Airport*> &airports,
+        std::map<std::pair<Airport*, Airport*>, std::vector<Flight>> &flights, size_t &flight_count);
+
+    /** Merge the loaded flights into scheduled flights and build the graph.
+     * Prints a summary of the flights that were loaded.
+     * @param arena The arena holding the airports. Its airports move to the graph, and it is left empty.
+     * @param airports Map of airport id to airport
+     * @param flights Map of (departure, arrival) to the monthly flights between them
+     * @param line_count The number of lines read (used for statistics only)
+     * @return the graph
+     */
+    std::unique_ptr<data::Graph> buildGraph(data::Arena<Airport> &arena, std::map<size_t, Airport*> &airports,
+        std::map<std::pair<Airport*, Airport*>, std::vector<Flight>> &flights, size_t line_count);
+
     /** Merges flights into a new map given a frequency.
      * For example, if there are 4 flights to ORD from LAX on the same weekday by the same airline,
      * set a single flight with weekly frequency instead.
@@ -22,6 +138,19 @@ namespace io {
         std::map<std::pair<Airport*, Airport*>, std::vector<Flight>> &flights,
         data::Frequency newFreq, size_t threshold);
 
+    /** Merges monthly flights into weekly and then daily flights in a single pass per route.
+     * Produces exactly the same flights (in the same order) as
+     * mergeFlights(flights, WEEKLY, weeklyThreshold) followed by mergeFlights(..., DAILY, dailyThreshold),
+     * but groups similar flights in hash buckets instead of comparing every pair of flights on a route.
+     * @param flights A map<departure,arrival> , <monthly flights from depart to arrive> to merge
+     * @param weeklyThreshold The number of similar flights on the same weekday needed for a weekly flight (at least 1)
+     * @param dailyThreshold The number of similar weekly flights needed for a daily flight (at least 1)
+     * @return a new map, with the same formatting as flights, with merged flights.
+     */
+    std::map<std::pair<Airport*, Airport*>, std::vector<Flight>> mergeSchedules(
+        const std::map<std::pair<Airport*, Airport*>, std::vector<Flight>> &flights,
+        size_t weeklyThreshold = 3, size_t dailyThreshold = 6);
+
     /** Checks that the file is valid
      * @param filepath The filepath
      * @throws -1 if the file cannot be opened
@@ -32,9 +161,23 @@ namespace io {
     std::ifstream openFile(const std::string &filepath);
 
     // Load the file given a filepath.
-    data::Graph* loadFile(const std::string &filepath);
+    std::unique_ptr<data::Graph> loadFile(const std::string &filepath);
 
     // Load the file given an ifstream.
-    data::Graph* loadFile(std::ifstream &file);
+    std::unique_ptr<data::Graph> loadFile(std::ifstream &file);
+
+    /** Load the file by memory-mapping it and parsing the fields in place.
+     * Produces the same graph as loadFile, but without creating a string per line or per field.
+     * The file is cut into newline-aligned chunks that are parsed in parallel, then merged in file order,
+     * so flight ids (and the graph) do not depend on the number of threads.
+     * Prints the ingest throughput in bytes/sec and rows/sec.
+     * @param filepath The filepath
+     * @param threads The number of worker threads to parse with
+     * @throws -1 if the file cannot be opened
+     * @throws -2 if the file is not a .csv
+     * @throws -3 if the file is valid, but does not contain readable data
+     * @return the graph
+     */
+    std::unique_ptr<data::Graph> loadFileMapped(const std::string &filepath, size_t threads = 1);
 
 } // namespace io
\ No newline at end of file
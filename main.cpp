@@ -1,15 +1,21 @@
 #include "graph.h"
 #include "loadfile.h"
+#include "snapshot.h"
 #include "utils.h"
 
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <fstream>
+#include <memory>
+#include <stdexcept>
 #include <string>
+#include <thread>
 #include <vector>
 
 using data::Graph;
 using data::Airport;
-using io::loadFile;
+using io::loadFileMapped;
 
 /** Main function.
  * 
@@ -20,8 +26,12 @@ using io::loadFile;
  * Command line parameters:
  * - First parameter MUST be the name of the file with the flight data (input file).
  *   This can be left blank, but this forces manual mode, and you must input the file at the command line.
+ *   After the first run, the loaded graph is saved next to the input file (as [file].snap) and later runs
+ *   load it from there instead, until the input file changes.
+ * - -j [N] option: Parses the input file on N threads (defaults to, and at most, the number of cores).
+ *   If this is an option, it MUST come right after the input file.
  * - -a option: Executes the entire program automatically, with no input from cin. 
- *   If this is an option, it MUST be passed second.
+ *   If this is an option, it MUST be passed second (or right after -j N).
  *   If -a is used, only one command can be executed.
  *   If -a is used, the next argument MUST be the command. 
  *   (for example: ... -a shortestpath DEN ORD)
@@ -29,28 +39,145 @@ using io::loadFile;
  * 
  * Commands:
  * - quit: quits the program.
- * - rank: Ranks airports.
- * - shortestpath [X] [Y] [start] [connection]: returns shortest path from X to Y. Arguments X and Y are required.
+ * - rank [N]: Ranks airports. If N is given, only the top N airports are printed.
+ * - rank pagerank [damping] [X...] [N]: Ranks airports with a damped PageRank (damping 0.85 by default).
+ *   Each X is a three letter airport code or a two letter airline code. If any are given, the ranking is relative to
+ *   those airports (or the airline's hubs). Later rankings start from the previous one.
+ * - shortestpath [X] [Y] [start] [connection]: returns the itinerary from X to Y that arrives earliest. Arguments X and Y are required.
  *   Start and connection are optional. Connection is the minimum connection time (in minutes, must be an integer)
  *   Start is the starting time given as an hhmm string. (ie 1340 is 13:40 or 1:40 PM).
  *   If one of [start, connection] is provided, both must be provided. You cannot provide just one.
  * 
+ * - profile [X] [Y] [connection]: for every departure time, returns the itinerary from X to Y that arrives earliest.
+ *   Arguments X and Y are required. Connection is optional and is the minimum connection time (in minutes).
+ *   Only itineraries that no later departure beats are printed, in order of departure.
+ * 
  * - furthest [X]: return the furthest airports from X. This algorithm counts using number of stopovers.
+ * - furthest all: return the most stopovers needed between any two airports, and how many every airport needs.
+ * - stops [X] [Y]: return the fewest flights needed to get from X to Y. Both arguments are required.
  * 
  * Here, X and Y must be a three letter airport code, i.e. ORD.
  * 
  */
 
-void handleRank(const Graph &g) {
-    std::vector<Airport*> ranking = g.rankAirports();
+// Graphs with at most this many airports get a stop table (one byte per pair of airports, 64MB at most).
+const size_t STOP_TABLE_MAX_AIRPORTS = 8192;
+
+/** Load the graph from the input file's snapshot, or from the input file if the snapshot is missing or stale.
+ * After loading from the input file, computes the stop table (on the given threads) and saves a new snapshot for the next run.
+ * @throws the same exceptions as io::loadFileMapped
+ */
+std::unique_ptr<Graph> loadGraph(const std::string &file, size_t threads) {
+    std::string snapshot = io::snapshotPath(file);
+
+    try {
+        auto start = std::chrono::steady_clock::now();
+        std::unique_ptr<Graph> g = io::loadSnapshot(snapshot, file);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::cout << "Loaded " << snapshot << " in " << 1000 * seconds << "ms." << std::endl;
+        return g;
+    } catch (int) {
+        // no usable snapshot, load the file instead
+    }
+
+    std::unique_ptr<Graph> g = loadFileMapped(file, threads);
+
+    if (g->getAirports().size() <= STOP_TABLE_MAX_AIRPORTS) {
+        try {
+            auto start = std::chrono::steady_clock::now();
+            g->computeStopTable(threads);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            std::cout << "Counted flights between every pair of airports in " << 1000 * seconds << "ms." << std::endl;
+        } catch (int) {
+            // stops will search instead
+        }
+    }
+
+    try {
+        io::saveSnapshot(*g, snapshot, file);
+        std::cout << "Saved snapshot to " << snapshot << "." << std::endl;
+    } catch (int) {
+        std::cout << "Could not save a snapshot. The file will be loaded again on the next run." << std::endl;
+    }
+
+    return g;
+}
+
+void handleRank(const std::string &command, const Graph &g, size_t threads) {
+    std::vector<std::string> command_split;
+
+    for (const std::string &word : utils::split(command, ' ')) {
+        if (!word.empty()) command_split.push_back(word);
+    }
+
+    data::RankStats stats;
+    std::vector<std::pair<Airport*, double>> ranking;
+
+    // a number at the end of the command is how many airports to print
+    size_t top = SIZE_MAX;
+
+    if (command_split.size() > 1 && command_split.back().find_first_not_of("0123456789") == std::string::npos) {
+        try {
+            top = std::stoul(command_split.back());
+        } catch (std::out_of_range &) {
+            std::cout << "Command is invalid. Please try again." << std::endl;
+            return;
+        }
+
+        command_split.pop_back();
+    }
+
+    if (command_split.size() > 1 && command_split[1] == "pagerank") {
+        data::RankOptions options;
+
+        try {
+            for (size_t i = 2; i < command_split.size(); i++) {
+                const std::string &word = command_split[i];
+
+                if (word.find('.') != std::string::npos) {
+                    options.damping = std::stod(word);
+                } else if (word.size() == 2) {
+                    std::vector<std::pair<Airport*, double>> hubs = g.airlineHubs(word);
+                    if (hubs.empty()) throw -1;
+
+                    options.personalization.insert(options.personalization.end(), hubs.begin(), hubs.end());
+                } else {
+                    options.personalization.push_back(std::pair<Airport*, double>(g.getVertex(word), 1));
+                }
+            }
+
+            ranking = g.rankAirports(options, top, &stats, threads);
+        } catch (std::invalid_argument &) {
+            std::cout << "Damping factor was not understood. Please try again." << std::endl;
+            return;
+        } catch (std::out_of_range &) {
+            std::cout << "Damping factor was not understood. Please try again." << std::endl;
+            return;
+        } catch (int) {
+            std::cout << "An airport or airline you entered is not in the database, or the damping factor is not between 0 and 1." << std::endl;
+            return;
+        }
+
+        std::cout << "Ranking of all airports using PageRank (damping " << options.damping << "):" << std::endl;
+    } else if (command_split.size() > 1) {
+        std::cout << "Command is invalid. Please try again." << std::endl;
+        return;
+    } else {
+        ranking = g.rankAirports(top, &stats, threads);
+        std::cout << "Ranking of all airports using Markov chain:" << std::endl;
+    }
 
     size_t rank = 1;
-    std::cout << "Ranking of all airports using Markov chain:" << std::endl;
 
-    for (Airport *a : ranking) {
-        std::cout << rank << ". " << a -> airport_code << std::endl;
+    for (const std::pair<Airport*, double> &a : ranking) {
+        std::cout << rank << ". " << a.first -> airport_code << " (" << a.second << ")" << std::endl;
         rank++;
     }
+
+    std::cout << "Converged in " << stats.iterations << " iterations (residual " << stats.residual << ")"
+              << (stats.warm_start ? ", starting from the previous ranking." : ".") << std::endl;
 }
 
 void handleShortestPath(const std::string &command, const Graph &g) {
@@ -74,7 +201,7 @@ void handleShortestPath(const std::string &command, const Graph &g) {
     }
 
     try{
-        std::vector<Flight> path = g.shortestPath(g.getVertex(command_split[1]), g.getVertex(command_split[2]), start, connection);
+        std::vector<Flight> path = g.earliestArrival(g.getVertex(command_split[1]), g.getVertex(command_split[2]), start, connection);
         size_t flight_count = 1;
 
         for (Flight f: path) {
@@ -90,6 +217,49 @@ void handleShortestPath(const std::string &command, const Graph &g) {
 
 }
 
+void handleProfile(const std::string &command, const Graph &g) {
+    std::vector<std::string> command_split = utils::split(command, ' ');
+
+    size_t connection = 0;
+
+    if (command_split.size() < 3 || command_split.size() > 4) {
+        std::cout << "Command is invalid. Please try again." << std::endl;
+        return;
+    }
+
+    if (command_split.size() == 4) {
+        try {
+            connection = std::stoi(command_split[3]);
+        } catch (std::invalid_argument &) {
+            std::cout << "Connection was not understood. Using default value of 0." << std::endl;
+        }
+    }
+
+    try {
+        std::vector<std::vector<Flight>> journeys = g.profile(g.getVertex(command_split[1]), g.getVertex(command_split[2]), connection);
+
+        if (journeys.empty()) {
+            std::cout << "No same day flight itinerary exists with these parameters." << std::endl;
+            return;
+        }
+
+        std::cout << "Earliest arrivals from " << command_split[1] << " to " << command_split[2] << " by departure time:" << std::endl;
+
+        for (const std::vector<Flight> &path : journeys) {
+            std::cout << utils::printTime(path.front().depart_time) << " -> " << utils::printTime(path.back().arrive_time) << ": ";
+            std::cout << path.front().departure->airport_code;
+
+            for (const Flight &f : path) {
+                std::cout << " -> " << f.arrival->airport_code;
+            }
+
+            std::cout << std::endl;
+        }
+    } catch (int i) {
+        std::cout << "The airport you entered is not in the database. Please try again." << std::endl;
+    }
+}
+
 void handleBFS(const std::string &command, const Graph &g) {
     std::vector<std::string> command_split = utils::split(command, ' ');
 
@@ -98,9 +268,39 @@ void handleBFS(const std::string &command, const Graph &g) {
         return;
     }
 
-    try {
+    if (command_split[1] == "all") {
+        auto start = std::chrono::steady_clock::now();
+        data::Eccentricities all = g.eccentricities();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        // how many airports need each number of flights to reach everything they can
+        std::vector<size_t> count(all.diameter + 1, 0);
+        for (size_t stops : all.eccentricity) count[stops]++;
+
+        std::cout << "Most flights needed between two airports: " << all.diameter << std::endl;
+        for (size_t i = 0; i < all.airports.size(); i++) {
+            if (all.eccentricity[i] != all.diameter) continue;
 
-        std::vector<Airport*> airports = g.findFurthestAirports(g.getVertex(command_split[1]));
+            std::cout << all.airports[i] -> airport_code << " to ";
+            for (Airport *a : all.furthest[i]) {
+                std::cout << a -> airport_code << ", ";
+            }
+            std::cout << std::endl;
+        }
+
+        std::cout << "Fewest flights needed to reach every other airport from one airport: " << all.radius << std::endl;
+        for (size_t stops = 0; stops < count.size(); stops++) {
+            std::cout << count[stops] << " airports need " << stops << " flights." << std::endl;
+        }
+
+        std::cout << "Found in " << 1000 * seconds << "ms." << std::endl;
+        return;
+    }
+
+    try {
+        Airport *start = g.getVertex(command_split[1]);
+        size_t stops;
+        std::vector<Airport*> airports = g.findFurthestAirports(start, &stops);
 
         std::cout << "Furthest airports from " << command_split[1] << ": ";
         for (Airport *a: airports) {
@@ -109,10 +309,73 @@ void handleBFS(const std::string &command, const Graph &g) {
 
         std::cout << std::endl;
 
-        std::cout << "Flight count: " << g.stopCount(g.getVertex(command_split[1])) << std::endl; 
+        std::cout << "Flight count: " << stops << std::endl;
+    } catch (int i) {
+        std::cout << "The airport you entered is not in the database. Please try again." << std::endl;
+    }
+}
+
+void handleStops(const std::string &command, const Graph &g) {
+    std::vector<std::string> command_split = utils::split(command, ' ');
+
+    if (command_split.size() != 3) {
+        std::cout << "Command is invalid. Please try again." << std::endl;
+        return;
+    }
+
+    Airport *depart, *arrive;
+
+    try {
+        depart = g.getVertex(command_split[1]);
+        arrive = g.getVertex(command_split[2]);
     } catch (int i) {
         std::cout << "The airport you entered is not in the database. Please try again." << std::endl;
+        return;
+    }
+
+    try {
+        std::cout << "Flights from " << command_split[1] << " to " << command_split[2] << ": " << g.stops(depart, arrive) << std::endl;
+    } catch (int i) {
+        std::cout << "There is no route from " << command_split[1] << " to " << command_split[2] << "." << std::endl;
+    }
+}
+
+void handleUnmet(const std::string &command, const Graph &g, size_t threads) {
+    std::vector<std::string> command_split;
+
+    for (const std::string &word : utils::split(command, ' ')) {
+        if (!word.empty()) command_split.push_back(word);
+    }
+
+    size_t top = 10;
+
+    if (command_split.size() > 2 || (command_split.size() == 2 && command_split[1].find_first_not_of("0123456789") != std::string::npos)) {
+        std::cout << "Command is invalid. Please try again." << std::endl;
+        return;
     }
+
+    try {
+        if (command_split.size() == 2) top = std::stoul(command_split[1]);
+    } catch (std::out_of_range &) {
+        std::cout << "Command is invalid. Please try again." << std::endl;
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<data::UnmetDemand> pairs = g.unmetDemand(top, threads);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "Airports with no direct flight between them, by unmet demand:" << std::endl;
+
+    size_t rank = 1;
+
+    for (const data::UnmetDemand &pair : pairs) {
+        std::cout << rank << ". " << pair.first -> airport_code << " - " << pair.second -> airport_code << " (" << pair.score << "): "
+                  << pair.distance << " miles with one stop, " << pair.connections << " one-stop itineraries a month" << std::endl;
+        rank++;
+    }
+
+    std::cout << "Scored in " << 1000 * seconds << "ms." << std::endl;
 }
 
 void handleHelp() {
@@ -122,7 +385,14 @@ void handleHelp() {
     std::cout << "help: displays list of commands." << std::endl;
     std::cout << std::endl;
 
-    std::cout << "rank: rank airports using Markov chain." << std::endl;
+    std::cout << "rank (N): rank airports using Markov chain. If N is given, only show the top N airports." << std::endl;
+    std::cout << "example: rank 20 shows the 20 most important airports." << std::endl;
+    std::cout << std::endl;
+
+    std::cout << "rank pagerank (damping) (X...) (N): rank airports using PageRank with a damping factor (0.85 by default)." << std::endl;
+    std::cout << "Each X is a 3-letter airport code or a 2-letter airline code to rank relative to (its hubs, weighted by flights)." << std::endl;
+    std::cout << "Repeated rankings start from the previous one, so they finish quickly." << std::endl;
+    std::cout << "example: rank pagerank 0.9 ORD means rank airports by importance relative to ORD." << std::endl;
     std::cout << std::endl;
 
     std::cout << "shortestpath [X][Y] (start) (connection): Find the shortest path between X and Y." << std::endl;
@@ -132,24 +402,49 @@ void handleHelp() {
     std::cout << "example: shortestpath DEN ORD 1500 20 means shortest path from DEN to ORD starting at 15h0m and with a min connection of 20 minutes." << std::endl;
     std::cout << std::endl;
 
+    std::cout << "profile [X][Y] (connection): For every departure time, find the earliest arrival from X to Y." << std::endl;
+    std::cout << "X and Y are required and must be 3-letter airport codes. connection is optional (in minutes)." << std::endl;
+    std::cout << "example: profile DEN ORD 30 lists every itinerary from DEN to ORD that no later departure beats, with at least 30 minutes for each connection." << std::endl;
+    std::cout << std::endl;
+
     std::cout << "furthest [X]: Find the airports furthest from X. Counts using the number of stopovers." << std::endl;
     std::cout << "X is the three-letter code of an airport. It is required." << std::endl;
     std::cout << "example: furthest DFW means find the airports that require the most connections to get to from DFW." << std::endl;
     std::cout << std::endl;
 
+    std::cout << "furthest all: Find the furthest airports from every airport at once." << std::endl;
+    std::cout << "Prints the airports that are furthest apart, and how many airports need each number of flights." << std::endl;
+    std::cout << std::endl;
+
+    std::cout << "stops [X][Y]: Find the fewest flights needed to get from X to Y." << std::endl;
+    std::cout << "X and Y are required and must be 3-letter airport codes." << std::endl;
+    std::cout << "example: stops DEN ORD means find how many flights it takes to get from DEN to ORD." << std::endl;
+    std::cout << std::endl;
+
+    std::cout << "unmet (N): Find the N (10 by default) pairs of airports most in need of a direct flight." << std::endl;
+    std::cout << "Pairs one stop apart are scored by importance (PageRank), distance and how many one-stop itineraries they have." << std::endl;
+    std::cout << "example: unmet 20 shows the 20 pairs of airports with the most unmet demand." << std::endl;
+    std::cout << std::endl;
+
 }
 
-void handleCommand(const std::string &command, const Graph &g) {
+void handleCommand(const std::string &command, const Graph &g, size_t threads) {
     std::string word = utils::split(command, ' ')[0];
 
     if (word == "quit")
         exit(0);
     else if (word == "rank")
-        handleRank(g);
+        handleRank(command, g, threads);
     else if (word == "shortestpath")
         handleShortestPath(command, g);
+    else if (word == "profile")
+        handleProfile(command, g);
     else if (word == "furthest")
         handleBFS(command, g);
+    else if (word == "stops")
+        handleStops(command, g);
+    else if (word == "unmet")
+        handleUnmet(command, g, threads);
     else if (word == "help")
         handleHelp();
     else
@@ -166,29 +461,45 @@ int main(int argc, char *argv[]) {
         getline(std::cin, s);
     }
 
-    Graph *g1;
+    // Number of threads used to parse the file.
+    int arg = 2;
+    size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    size_t threads = cores;
+
+    if (argc > arg + 1 && std::string(argv[arg]) == "-j") {
+        try {
+            // more threads than cores only adds overhead
+            threads = std::min<size_t>(cores, std::max(1, std::stoi(argv[arg + 1])));
+        } catch (std::invalid_argument &) {
+            std::cout << "Thread count was not understood. Using " << threads << " threads." << std::endl;
+        } catch (std::out_of_range &) {
+            std::cout << "Thread count was not understood. Using " << threads << " threads." << std::endl;
+        }
+
+        arg += 2;
+    }
+
+    std::unique_ptr<Graph> g;
 
     try {
-        g1 = loadFile(s);
+        g = loadGraph(s, threads);
     } catch (int i) {
         std::cout << "File cannot be read. Please try again." << std::endl;
         return i;
     }
 
-    Graph g = *g1;
-
     // Runs in automatic mode.
-    if (argc > 2) {
-        std::string s(argv[2]);
+    if (argc > arg) {
+        std::string s(argv[arg]);
 
         if (s == "-a") {
             std::string command = "";
-            for (int i = 3; i < argc; i++) {
+            for (int i = arg + 1; i < argc; i++) {
                 command += argv[i];
                 command += " ";
             }
 
-            handleCommand(command, g);
+            handleCommand(command, *g, threads);
             exit(0);
         }
     }
@@ -200,11 +511,9 @@ int main(int argc, char *argv[]) {
         std::string command;
         std::cout << std::endl << "Enter command: ";
         getline(std::cin, command);
-        handleCommand(command, g);
+        handleCommand(command, *g, threads);
     }
 
-    delete g1;
-
     return 0;
 
 }
\ No newline at end of file
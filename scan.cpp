@@ -0,0 +1,196 @@
+#include "scan.h"
+
+#include <string>
+#include <string_view>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+/** State of a line being split into fields.
+ * The kernels only differ in how they find the next delimiter, and hand every comma,
+ * quote and newline they find to delimiter() in order.
+ */
+struct FieldSplitter {
+    FieldSplitter(std::string_view text, std::string_view *fields, size_t maxFields)
+        : text(text), fields(fields), maxFields(maxFields) {}
+
+    std::string_view text;
+    std::string_view *fields;
+    size_t maxFields;
+
+    size_t count = 0;
+    size_t start = 0;
+    bool quoted = false;
+
+    // End the current field just before position end.
+    void endField(size_t end) {
+        if (count < maxFields) fields[count] = text.substr(start, end - start);
+        count++;
+        start = end + 1;
+    }
+
+    // Handle the delimiter at position i. Returns true if it ends the line.
+    bool delimiter(size_t i) {
+        char c = text[i];
+
+        if (c == '"') {
+            quoted = !quoted;
+        } else if (c == '\n') {
+            endField(i);
+            return true;
+        } else if (!quoted) {
+            endField(i);
+        }
+
+        return false;
+    }
+
+    // Finish the line at the newline at position i, or at the end of the text.
+    size_t finish(size_t i, size_t &consumed) {
+        if (i == text.size()) {
+            endField(i);
+            consumed = text.size();
+        } else {
+            consumed = i + 1;
+        }
+
+        return count;
+    }
+};
+
+static bool isDelimiter(char c) {
+    return c == ',' || c == '"' || c == '\n';
+}
+
+// Scan the bytes from i to the end of the line one at a time.
+static size_t scanTail(FieldSplitter &s, size_t i, size_t &consumed) {
+    for (; i < s.text.size(); i++) {
+        if (isDelimiter(s.text[i]) && s.delimiter(i)) return s.finish(i, consumed);
+    }
+
+    return s.finish(i, consumed);
+}
+
+static size_t splitScalar(std::string_view text, std::string_view *fields, size_t maxFields, size_t &consumed) {
+    FieldSplitter s(text, fields, maxFields);
+    return scanTail(s, 0, consumed);
+}
+
+#ifdef SCAN_X86
+
+static size_t splitSSE2(std::string_view text, std::string_view *fields, size_t maxFields, size_t &consumed) {
+    FieldSplitter s(text, fields, maxFields);
+
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i newline = _mm_set1_epi8('\n');
+
+    size_t i = 0;
+
+    for (; i + 16 <= text.size(); i += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text.data() + i));
+        __m128i found = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, comma), _mm_cmpeq_epi8(block, quote)),
+                                     _mm_cmpeq_epi8(block, newline));
+
+        // one bit per delimiter in the block, lowest bit first
+        unsigned mask = _mm_movemask_epi8(found);
+
+        while (mask != 0) {
+            size_t at = i + __builtin_ctz(mask);
+            if (s.delimiter(at)) return s.finish(at, consumed);
+            mask &= mask - 1;
+        }
+    }
+
+    return scanTail(s, i, consumed);
+}
+
+__attribute__((target("avx2")))
+static size_t splitAVX2(std::string_view text, std::string_view *fields, size_t maxFields, size_t &consumed) {
+    FieldSplitter s(text, fields, maxFields);
+
+    const __m256i comma = _mm256_set1_epi8(',');
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i newline = _mm256_set1_epi8('\n');
+
+    size_t i = 0;
+
+    for (; i + 32 <= text.size(); i += 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text.data() + i));
+        __m256i found = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(block, comma), _mm256_cmpeq_epi8(block, quote)),
+                                        _mm256_cmpeq_epi8(block, newline));
+
+        // one bit per delimiter in the block, lowest bit first
+        unsigned mask = _mm256_movemask_epi8(found);
+
+        while (mask != 0) {
+            size_t at = i + __builtin_ctz(mask);
+            if (s.delimiter(at)) return s.finish(at, consumed);
+            mask &= mask - 1;
+        }
+    }
+
+    return scanTail(s, i, consumed);
+}
+
+#endif
+
+static bool supported(utils::ScanKernel kernel) {
+    switch (kernel) {
+        case utils::SCAN_SCALAR:
+            return true;
+#ifdef SCAN_X86
+        case utils::SCAN_SSE2:
+            return __builtin_cpu_supports("sse2");
+        case utils::SCAN_AVX2:
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return false;
+    }
+}
+
+static utils::ScanKernel bestKernel() {
+    if (supported(utils::SCAN_AVX2)) return utils::SCAN_AVX2;
+    if (supported(utils::SCAN_SSE2)) return utils::SCAN_SSE2;
+    return utils::SCAN_SCALAR;
+}
+
+static utils::ScanKernel active_kernel = bestKernel();
+
+size_t utils::splitFields(std::string_view text, std::string_view *fields, size_t maxFields, size_t &consumed) {
+    switch (active_kernel) {
+#ifdef SCAN_X86
+        case SCAN_AVX2:
+            return splitAVX2(text, fields, maxFields, consumed);
+        case SCAN_SSE2:
+            return splitSSE2(text, fields, maxFields, consumed);
+#endif
+        default:
+            return splitScalar(text, fields, maxFields, consumed);
+    }
+}
+
+utils::ScanKernel utils::scanKernel() {
+    return active_kernel;
+}
+
+bool utils::setScanKernel(ScanKernel kernel) {
+    if (!supported(kernel)) return false;
+
+    active_kernel = kernel;
+    return true;
+}
+
+std::string utils::scanKernelName(ScanKernel kernel) {
+    switch (kernel) {
+        case SCAN_SSE2:
+            return "sse2";
+        case SCAN_AVX2:
+            return "avx2";
+        default:
+            return "scalar";
+    }
+}
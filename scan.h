@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+namespace utils
+{
+    /** The implementations of splitFields. The best one supported by the CPU is picked at runtime.
+     */
+    enum ScanKernel {
+        SCAN_SCALAR,
+        SCAN_SSE2,
+        SCAN_AVX2,
+    };
+
+    /** Split the first line of a block of CSV text into fields.
+     * Commas, quotes and newlines are located 16 (SSE2) or 32 (AVX2) bytes at a time.
+     * Commas inside a quoted field do not split it, and the quotes are kept in the field.
+     * Only the first maxFields fields are stored, the rest are counted but ignored.
+     * @param text The text to split. The line ends at the first newline, or at the end of text.
+     * @param fields Output array of at least maxFields views into text
+     * @param maxFields The size of fields
+     * @param consumed Set to the length of the line, including its newline
+     * @return the number of fields in the line (may be more than maxFields)
+     */
+    size_t splitFields(std::string_view text, std::string_view *fields, size_t maxFields, size_t &consumed);
+
+    // Returns the kernel used by splitFields.
+    ScanKernel scanKernel();
+
+    /** Choose the kernel used by splitFields (used for benchmarking and testing).
+     * @return false (and leaves the kernel unchanged) if the CPU does not support it
+     */
+    bool setScanKernel(ScanKernel kernel);
+
+    // Returns the kernel's name, e.g. "avx2".
+    std::string scanKernelName(ScanKernel kernel);
+
+} // namespace utils
@@ -0,0 +1,278 @@
+#include "graph.h"
+#include "loadfile.h"
+#include "snapshot.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+using data::Airport;
+using data::Flight;
+using data::Graph;
+
+// File layout: header, airports, airlines, flights, the string table, then the stop table (if the graph had one).
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t airline_count;
+
+    uint64_t source_size;
+    int64_t source_mtime;
+
+    uint64_t airport_count;
+    uint64_t flight_count;
+    uint64_t string_bytes;
+    uint64_t stop_table_bytes;
+};
+
+// A string in the string table.
+struct SnapshotString {
+    uint32_t offset;
+    uint32_t length;
+};
+
+struct SnapshotAirport {
+    uint64_t airport_id;
+    SnapshotString code;
+};
+
+// Departure and arrival are indices into the airports, airline an index into the airlines.
+struct SnapshotFlight {
+    uint64_t flight_id;
+
+    uint32_t departure;
+    uint32_t arrival;
+
+    uint32_t depart_time;
+    uint32_t arrive_time;
+    uint32_t distance;
+    uint32_t airtime;
+
+    uint16_t airline;
+    uint8_t weekday;
+    uint8_t frequency;
+
+    // written as zeros, so the same graph always gives the same snapshot
+    uint8_t pad[4];
+};
+
+// the records are written as they are in memory, so their layout must not change
+static_assert(sizeof(SnapshotHeader) == 64, "snapshot header layout changed");
+static_assert(sizeof(SnapshotAirport) == 16, "snapshot airport layout changed");
+static_assert(sizeof(SnapshotFlight) == 40, "snapshot flight layout changed");
+
+static const char SNAPSHOT_MAGIC[8] = {'A', 'D', 'X', 'S', 'N', 'A', 'P', '\0'};
+
+// Size and modification time of the source file. Returns false if it cannot be read.
+static bool sourceInfo(const std::string &sourcePath, uint64_t &size, int64_t &mtime) {
+    struct stat info;
+    if (stat(sourcePath.c_str(), &info) != 0) return false;
+
+    size = info.st_size;
+    mtime = info.st_mtime;
+    return true;
+}
+
+std::string io::snapshotPath(const std::string &filepath) {
+    return filepath + ".snap";
+}
+
+void io::saveSnapshot(const Graph &g, const std::string &snapshotPath, const std::string &sourcePath) {
+    SnapshotHeader header;
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+
+    if (!sourceInfo(sourcePath, header.source_size, header.source_mtime)) {
+        std::cerr << "Could not read " << sourcePath << " to write its snapshot." << std::endl;
+        throw -1;
+    }
+
+    std::string strings;
+
+    auto addString = [&](const std::string &s) {
+        SnapshotString out = {(uint32_t) strings.size(), (uint32_t) s.size()};
+        strings += s;
+        return out;
+    };
+
+    // airports, in id order
+    std::vector<Airport*> airports = g.getAirports();
+    std::sort(airports.begin(), airports.end(), [](Airport *a, Airport *b) { return a->airport_id < b->airport_id; });
+
+    std::map<size_t, uint32_t> airport_index;
+    std::vector<SnapshotAirport> airport_records;
+
+    for (Airport *a : airports) {
+        airport_index[a->airport_id] = airport_records.size();
+        airport_records.push_back(SnapshotAirport{a->airport_id, addString(a->airport_code)});
+    }
+
+    // flights, in flight id order, with their airlines numbered by the snapshot
+    // (Carrier ids depend on the order a program sees the carriers in, so the codes are saved instead)
+    std::vector<Flight> flights = g.getFlights();
+    std::sort(flights.begin(), flights.end(), [](const Flight &a, const Flight &b) { return a.flight_id < b.flight_id; });
+
+    std::map<data::Carrier, uint16_t> airline_index;
+    std::vector<SnapshotString> airline_records;
+    std::vector<SnapshotFlight> flight_records;
+
+    for (const Flight &f : flights) {
+        auto airline = airline_index.find(f.airline);
+
+        if (airline == airline_index.end()) {
+            airline = airline_index.insert(std::make_pair(f.airline, (uint16_t) airline_records.size())).first;
+            airline_records.push_back(addString(f.airline.code()));
+        }
+
+        SnapshotFlight record = SnapshotFlight();
+        record.flight_id = f.flight_id;
+        record.departure = airport_index[f.departure->airport_id];
+        record.arrival = airport_index[f.arrival->airport_id];
+        record.depart_time = f.depart_time;
+        record.arrive_time = f.arrive_time;
+        record.distance = f.distance;
+        record.airtime = f.airtime;
+        record.airline = airline->second;
+        record.weekday = f.weekday;
+        record.frequency = f.frequency;
+
+        flight_records.push_back(record);
+    }
+
+    header.airline_count = airline_records.size();
+    header.airport_count = airport_records.size();
+    header.flight_count = flight_records.size();
+    header.string_bytes = strings.size();
+    header.stop_table_bytes = g.getStopTable().size();
+
+    std::string temp_path = snapshotPath + ".tmp";
+    std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(airport_records.data()), airport_records.size() * sizeof(SnapshotAirport));
+    out.write(reinterpret_cast<const char*>(airline_records.data()), airline_records.size() * sizeof(SnapshotString));
+    out.write(reinterpret_cast<const char*>(flight_records.data()), flight_records.size() * sizeof(SnapshotFlight));
+    out.write(strings.data(), strings.size());
+    out.write(reinterpret_cast<const char*>(g.getStopTable().data()), g.getStopTable().size());
+    out.close();
+
+    if (!out || std::rename(temp_path.c_str(), snapshotPath.c_str()) != 0) {
+        std::remove(temp_path.c_str());
+        std::cerr << "Could not write snapshot " << snapshotPath << "." << std::endl;
+        throw -1;
+    }
+}
+
+std::unique_ptr<Graph> io::loadSnapshot(const std::string &snapshotPath, const std::string &sourcePath) {
+    uint64_t source_size;
+    int64_t source_mtime;
+
+    if (!sourceInfo(sourcePath, source_size, source_mtime)) throw -1;
+
+    // not having a snapshot yet is normal, don't let MappedFile report it as an error
+    struct stat info;
+    if (stat(snapshotPath.c_str(), &info) != 0) throw -1;
+
+    MappedFile file(snapshotPath);
+
+    // check the header before trusting any of the counts in it
+    if (file.size() < sizeof(SnapshotHeader)) throw -4;
+
+    SnapshotHeader header;
+    std::memcpy(&header, file.data(), sizeof(header));
+
+    if (std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 || header.version != SNAPSHOT_VERSION) throw -4;
+    if (header.source_size != source_size || header.source_mtime != source_mtime) throw -4;
+
+    // each section has to fit in what is left of the file, checked by division so a huge count cannot overflow
+    uint64_t remaining = file.size() - sizeof(SnapshotHeader);
+
+    auto section = [&remaining](uint64_t count, uint64_t size) {
+        if (count > remaining / size) throw -4;
+        remaining -= count * size;
+    };
+
+    section(header.airport_count, sizeof(SnapshotAirport));
+    section(header.airline_count, sizeof(SnapshotString));
+    section(header.flight_count, sizeof(SnapshotFlight));
+    section(header.string_bytes, 1);
+    section(header.stop_table_bytes, 1);
+
+    if (remaining != 0) throw -4;
+
+    // airports get 32-bit dense indices, which also keeps the table size below from overflowing
+    if (header.airport_count > UINT32_MAX) throw -4;
+    if (header.stop_table_bytes != 0 && header.stop_table_bytes != header.airport_count * header.airport_count) throw -4;
+
+    // the sections are known to lie within the file now
+    const char *airport_start = file.data() + sizeof(SnapshotHeader);
+    const char *airline_start = airport_start + header.airport_count * sizeof(SnapshotAirport);
+    const char *flight_start = airline_start + header.airline_count * sizeof(SnapshotString);
+    const char *string_start = flight_start + header.flight_count * sizeof(SnapshotFlight);
+
+    const char *stop_table_start = string_start + header.string_bytes;
+
+    const SnapshotAirport *airport_records = reinterpret_cast<const SnapshotAirport*>(airport_start);
+    const SnapshotString *airline_records = reinterpret_cast<const SnapshotString*>(airline_start);
+    const SnapshotFlight *flight_records = reinterpret_cast<const SnapshotFlight*>(flight_start);
+
+    auto getString = [&](const SnapshotString &s) {
+        if ((uint64_t) s.offset + s.length > header.string_bytes) throw -4;
+        return std::string(string_start + s.offset, s.length);
+    };
+
+    // validate everything before allocating, so a corrupt snapshot cannot leak airports
+    std::vector<data::Carrier> airlines;
+    for (uint32_t i = 0; i < header.airline_count; i++) airlines.push_back(getString(airline_records[i]));
+
+    std::vector<std::string> codes;
+    for (uint64_t i = 0; i < header.airport_count; i++) codes.push_back(getString(airport_records[i].code));
+
+    for (uint64_t i = 0; i < header.flight_count; i++) {
+        const SnapshotFlight &record = flight_records[i];
+
+        if (record.departure >= header.airport_count || record.arrival >= header.airport_count ||
+            record.airline >= header.airline_count || record.frequency > data::MONTHLY) throw -4;
+    }
+
+    std::unique_ptr<Graph> g(new Graph());
+    std::vector<Airport*> airports;
+
+    for (uint64_t i = 0; i < header.airport_count; i++) {
+        airports.push_back(g->createVertex(airport_records[i].airport_id, codes[i]));
+    }
+
+    for (uint64_t i = 0; i < header.flight_count; i++) {
+        const SnapshotFlight &record = flight_records[i];
+
+        Flight f;
+        f.flight_id = record.flight_id;
+        f.departure = airports[record.departure];
+        f.arrival = airports[record.arrival];
+        f.depart_time = record.depart_time;
+        f.arrive_time = record.arrive_time;
+        f.distance = record.distance;
+        f.airtime = record.airtime;
+        f.airline = airlines[record.airline];
+        f.weekday = record.weekday;
+        f.frequency = (data::Frequency) record.frequency;
+
+        g->createEdge(f);
+    }
+
+    g->freeze();
+
+    if (header.stop_table_bytes != 0) {
+        g->setStopTable(std::vector<uint8_t>(stop_table_start, stop_table_start + header.stop_table_bytes));
+    }
+
+    return g;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "graph.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace io {
+
+    /** Binary snapshots of a loaded graph, so later runs can skip parsing and merging the CSV.
+     *
+     * A snapshot holds the airports and the merged flights (with their frequencies) in fixed-size records,
+     * followed by a table of the airport codes and airlines, and the graph's stop table if it has one.
+     * It also records the size and modification time of the CSV it was built from, and is considered stale as soon as either changes.
+     * Snapshots are written in the machine's byte order and are not meant to be moved between machines.
+     */
+
+    // The version written to new snapshots. Snapshots with any other version are ignored.
+    const uint32_t SNAPSHOT_VERSION = 2;
+
+    /** Returns the path of the snapshot for a CSV file (the same path, with .snap appended).
+     */
+    std::string snapshotPath(const std::string &filepath);
+
+    /** Write a snapshot of a graph.
+     * The snapshot is written to a temporary file first, so a failed write never leaves a broken snapshot behind.
+     * @param g The graph
+     * @param snapshotPath Where to write the snapshot
+     * @param sourcePath The CSV file the graph was loaded from
+     * @throws -1 if the source file cannot be read or the snapshot cannot be written
+     */
+    void saveSnapshot(const data::Graph &g, const std::string &snapshotPath, const std::string &sourcePath);
+
+    /** Load a graph from a snapshot by memory-mapping it.
+     * @param snapshotPath The snapshot
+     * @param sourcePath The CSV file the snapshot should have been built from
+     * @throws -1 if the snapshot or the source file cannot be opened
+     * @throws -4 if the snapshot is corrupt, from another version, or older than the source file
+     * @return the graph
+     */
+    std::unique_ptr<data::Graph> loadSnapshot(const std::string &snapshotPath, const std::string &sourcePath);
+
+} // namespace io
@@ -0,0 +1,94 @@
+#include "../graph.h"
+#include "../loadfile.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+/** Benchmark for the merge phase of loading.
+ * Compares two passes of io::mergeFlights with io::mergeSchedules, on the largest routes and on the whole file.
+ * Build and run using:
+ * make benchmerge
+ * ./benchmerge [file.csv] [number of routes]
+ */
+
+typedef std::map<std::pair<Airport*, Airport*>, std::vector<Flight>> FlightMap;
+
+// Time a merge function in seconds (best of a few runs, for small inputs).
+template <typename Fn>
+double timeMerge(const FlightMap &flights, Fn merge, size_t &unique) {
+    double best = 1e30;
+
+    for (size_t run = 0; run < 3; run++) {
+        FlightMap copy = flights;
+
+        auto start = std::chrono::steady_clock::now();
+        FlightMap merged = merge(copy);
+        best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+        unique = 0;
+        for (auto &i : merged) unique += i.second.size();
+    }
+
+    return best;
+}
+
+FlightMap mergeTwice(FlightMap &flights) {
+    FlightMap merged = io::mergeFlights(flights, data::WEEKLY, 3);
+    return io::mergeFlights(merged, data::DAILY, 6);
+}
+
+FlightMap mergeBuckets(FlightMap &flights) {
+    return io::mergeSchedules(flights, 3, 6);
+}
+
+void compare(const std::string &name, const FlightMap &flights) {
+    size_t rows = 0;
+    for (auto &i : flights) rows += i.second.size();
+
+    size_t unique_old, unique_new;
+    double old_time = timeMerge(flights, mergeTwice, unique_old);
+    double new_time = timeMerge(flights, mergeBuckets, unique_new);
+
+    std::cout << name << ": " << rows << " rows -> " << unique_new << " flights"
+              << (unique_old == unique_new ? "" : " (MISMATCH)") << ", mergeFlights " << 1e3 * old_time
+              << " ms, mergeSchedules " << 1e3 * new_time << " ms, speedup " << old_time / new_time << "x" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    std::string file = argc > 1 ? argv[1] : "data/july-2019-data.csv";
+    size_t top = argc > 2 ? std::stoi(argv[2]) : 5;
+
+    io::MappedFile mapped(file);
+    std::string_view contents = mapped.view();
+
+    io::ParsedChunk chunk;
+    io::parseChunk(contents.substr(contents.find('\n') + 1), chunk);
+
+    FlightMap flights;
+    data::Arena<Airport> arena;
+    std::map<size_t, Airport*> airports;
+    size_t flight_count = 0;
+    io::mergeChunk(chunk, arena, airports, flights, flight_count);
+
+    // Largest routes first
+    std::vector<FlightMap::const_iterator> routes;
+    for (auto i = flights.cbegin(); i != flights.cend(); i++) routes.push_back(i);
+
+    std::sort(routes.begin(), routes.end(), [](FlightMap::const_iterator a, FlightMap::const_iterator b) {
+        return a->second.size() > b->second.size();
+    });
+
+    for (size_t i = 0; i < top && i < routes.size(); i++) {
+        FlightMap single;
+        single.insert(*routes[i]);
+        compare(routes[i]->first.first->airport_code + "-" + routes[i]->first.second->airport_code, single);
+    }
+
+    compare("All routes", flights);
+
+    return 0;
+}
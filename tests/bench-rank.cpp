@@ -0,0 +1,64 @@
+#include "../utils.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+/** Benchmark for sparse power iteration (the kernel behind Graph::rankAirports).
+ * Builds a random column-stochastic matrix shaped like a large route network and times a fixed number of iterations
+ * with 1, 2, 4, ... threads, up to the number of cores.
+ * Build and run using:
+ * make benchrank
+ * ./benchrank [airports] [routes per airport] [iterations]
+ */
+
+int main(int argc, char *argv[]) {
+    size_t n = argc > 1 ? std::stoul(argv[1]) : 20000;
+    size_t degree = argc > 2 ? std::stoul(argv[2]) : 50;
+    size_t iterations = argc > 3 ? std::stoul(argv[3]) : 100;
+
+    // a few hubs get most of the routes, like the real network
+    std::mt19937_64 random(225);
+    std::vector<utils::MatrixEntry> entries;
+
+    for (size_t col = 0; col < n; col++) {
+        for (size_t k = 0; k < degree; k++) {
+            size_t row = (size_t) (n * std::pow(std::generate_canonical<double, 53>(random), 3)) % n;
+            entries.push_back(utils::MatrixEntry{row, col, 1.0 / degree});
+        }
+    }
+
+    utils::SparseMatrix matrix = utils::sparseMatrix(n, n, entries);
+    std::cout << n << " airports, " << matrix.values.size() << " routes, " << iterations << " iterations" << std::endl;
+
+    size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<double> first;
+    double single = 0;
+
+    for (size_t threads = 1; threads <= cores; threads *= 2) {
+        std::vector<double> state(n, 1.0 / n);
+        double residual = 0;
+
+        auto start = std::chrono::steady_clock::now();
+        utils::powerIteration(matrix, state, 0, iterations, residual, threads);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        if (threads == 1) {
+            first = state;
+            single = seconds;
+        }
+
+        double difference = 0;
+        for (size_t i = 0; i < n; i++) difference = std::max(difference, std::abs(state[i] - first[i]));
+
+        std::cout << threads << " thread(s): " << 1e3 * seconds / iterations << " ms/iteration, speedup " << single / seconds
+                  << "x, residual " << residual << ", max difference from 1 thread " << difference << std::endl;
+    }
+
+    return 0;
+}
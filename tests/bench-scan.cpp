@@ -0,0 +1,84 @@
+#include "../scan.h"
+#include "../utils.h"
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/** Micro-benchmark for splitting BTS rows into fields.
+ * Compares utils::split with every splitFields kernel the CPU supports.
+ * Build and run using:
+ * make benchscan
+ * ./benchscan [file.csv]
+ */
+
+// Time fn over every line, repeated until roughly a second has passed.
+template <typename Fn>
+void bench(const std::string &name, const std::vector<std::string> &lines, size_t bytes, Fn fn) {
+    size_t checksum = 0;
+    size_t rounds = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    double seconds = 0;
+
+    while (seconds < 1.0) {
+        for (const std::string &line : lines) checksum += fn(line);
+        rounds++;
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    double rows = (double) rounds * lines.size();
+
+    std::cout << name << ": " << 1e9 * seconds / rows << " ns/row, "
+              << rounds * bytes / seconds / 1e6 << " MB/s (checksum " << checksum << ")" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    std::string file = argc > 1 ? argv[1] : "data/july-2019-data.csv";
+    std::ifstream in(file);
+
+    if (!in.is_open()) {
+        std::cerr << "Could not open " << file << std::endl;
+        return 1;
+    }
+
+    // Skip the header and keep the rows (with their newline, as the loader sees them)
+    std::vector<std::string> lines;
+    std::string line;
+    size_t bytes = 0;
+
+    getline(in, line);
+    while (getline(in, line)) {
+        lines.push_back(line + "\n");
+        bytes += lines.back().size();
+    }
+
+    std::cout << "Splitting " << lines.size() << " rows (" << bytes << " bytes) from " << file << std::endl;
+
+    bench("utils::split (strings)", lines, bytes, [](const std::string &l) {
+        return utils::split(l, ',').size();
+    });
+
+    bench("utils::split (views)", lines, bytes, [](const std::string &l) {
+        std::string_view fields[11];
+        return utils::split(l, ',', fields, 11) + fields[10].size();
+    });
+
+    for (utils::ScanKernel kernel : {utils::SCAN_SCALAR, utils::SCAN_SSE2, utils::SCAN_AVX2}) {
+        if (!utils::setScanKernel(kernel)) {
+            std::cout << "splitFields (" << utils::scanKernelName(kernel) << "): not supported" << std::endl;
+            continue;
+        }
+
+        bench("splitFields (" + utils::scanKernelName(kernel) + ")", lines, bytes, [](const std::string &l) {
+            std::string_view fields[11];
+            size_t consumed;
+            return utils::splitFields(l, fields, 11, consumed) + fields[10].size() + consumed;
+        });
+    }
+
+    return 0;
+}
@@ -2,7 +2,10 @@
 #include "../catch/catch.hpp"
 #include "../graph.h"
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <set>
 
 using data::Graph;
 using data::Airport;
@@ -507,4 +510,993 @@ TEST_CASE("Shortest Path") {
     flights.clear();
     REQUIRE_THROWS(graph.shortestPath(a, c, 1800, 0) == flights);
 
-}
\ No newline at end of file
+}
+
+// Every query on every pair of airports, to compare a graph before and after freezing it.
+struct QueryResults {
+    std::vector<std::vector<Airport*>> outgoing, incoming, furthest;
+    std::vector<size_t> stops;
+    std::vector<bool> adjacent;
+    std::vector<std::vector<Flight>> paths;
+
+    QueryResults(const Graph &graph, const std::vector<Airport*> &airports) {
+        for (Airport *a : airports) {
+            outgoing.push_back(graph.outgoingNodes(a));
+            incoming.push_back(graph.incomingNodes(a));
+            furthest.push_back(graph.findFurthestAirports(a));
+            stops.push_back(graph.stopCount(a));
+
+            for (Airport *b : airports) {
+                adjacent.push_back(graph.areAdjacent(a, b));
+
+                for (size_t start : {0, 600, 1000}) {
+                    try {
+                        paths.push_back(graph.shortestPath(a, b, start, 10));
+                    } catch (int) {
+                        paths.push_back(std::vector<Flight>(1));
+                    }
+                }
+            }
+        }
+    }
+};
+
+TEST_CASE("Frozen graphs answer queries the same way") {
+    std::vector<Airport*> airports;
+
+    for (size_t i = 0; i < 7; i++) {
+        airports.push_back(new Airport());
+        airports.back()->airport_id = i + 1;
+    }
+
+    Graph graph;
+    for (Airport *a : airports) graph.createVertex(a);
+
+    // a few routes with multi-edges, a cycle and an airport with no flights
+    size_t routes[][4] = {{0, 1, 700, 900}, {0, 2, 1700, 1800}, {1, 4, 800, 1000}, {1, 4, 930, 1130}, {3, 4, 1200, 1230},
+                          {4, 3, 1740, 1800}, {4, 5, 1130, 1750}, {4, 5, 1145, 1730}, {5, 0, 1800, 1900}, {2, 1, 1900, 2000}};
+
+    size_t id = 0;
+    for (auto &r : routes) {
+        Flight f;
+        f.departure = airports[r[0]];
+        f.arrival = airports[r[1]];
+        f.depart_time = r[2];
+        f.arrive_time = r[3];
+        f.flight_id = id++;
+        graph.createEdge(f);
+    }
+
+    QueryResults before(graph, airports);
+    size_t flight_count = graph.getFlights().size();
+
+    graph.freeze();
+    REQUIRE(graph.isFrozen());
+
+    QueryResults after(graph, airports);
+
+    REQUIRE(after.outgoing == before.outgoing);
+    REQUIRE(after.incoming == before.incoming);
+    REQUIRE(after.furthest == before.furthest);
+    REQUIRE(after.stops == before.stops);
+    REQUIRE(after.adjacent == before.adjacent);
+    REQUIRE(after.paths == before.paths);
+
+    REQUIRE(graph.getFlights().size() == flight_count);
+    REQUIRE(graph.getEdge(3).depart_time == 930);
+
+    // copies of a frozen graph are frozen too
+    Graph copy = graph;
+    REQUIRE(copy.isFrozen());
+
+    // adding a flight unfreezes the graph
+    Flight extra;
+    extra.departure = airports[6];
+    extra.arrival = airports[0];
+    extra.flight_id = id++;
+    graph.createEdge(extra);
+
+    REQUIRE_FALSE(graph.isFrozen());
+    REQUIRE(graph.areAdjacent(airports[6], airports[0]));
+    REQUIRE(graph.getFlights().size() == flight_count + 1);
+    REQUIRE(graph.outgoingNodes(airports[4]) == before.outgoing[4]);
+}
+
+TEST_CASE("Frozen departures are sorted by time") {
+    Airport a, b, c;
+    a.airport_id = 1;
+    b.airport_id = 2;
+    c.airport_id = 3;
+
+    std::unordered_map<size_t, data::IncidentEdgeList> vertexList;
+    vertexList[1].airport = &a;
+    vertexList[2].airport = &b;
+    vertexList[3].airport = &c;
+
+    size_t times[] = {1200, 600, 1800, 600, 900};
+    Flight flights[5];
+    for (size_t i = 0; i < 5; i++) {
+        Flight &f = flights[i];
+        f.departure = &a;
+        f.arrival = (i % 2) ? &b : &c;
+        f.depart_time = times[i];
+        f.flight_id = i;
+        vertexList[1].departing.push_back(&f);
+        vertexList[f.arrival->airport_id].arriving.push_back(&f);
+    }
+
+    data::FrozenGraph frozen(vertexList);
+    uint32_t i = frozen.indexOf(&a);
+
+    std::vector<size_t> ids;
+    for (uint32_t k = frozen.out_offsets[i]; k < frozen.out_offsets[i + 1]; k++) {
+        ids.push_back(frozen.flight(frozen.out_by_time[k]).flight_id);
+    }
+
+    // equal times keep their departing list order
+    REQUIRE(ids == std::vector<size_t>({1, 3, 4, 0, 2}));
+
+    REQUIRE(frozen.firstDeparture(i, 0) == frozen.out_offsets[i]);
+    REQUIRE(frozen.firstDeparture(i, 600) == frozen.out_offsets[i]);
+    REQUIRE(frozen.firstDeparture(i, 601) == frozen.out_offsets[i] + 2);
+    REQUIRE(frozen.firstDeparture(i, 1800) == frozen.out_offsets[i] + 4);
+    REQUIRE(frozen.firstDeparture(i, 1801) == frozen.out_offsets[i + 1]);
+
+    // no departures at all
+    uint32_t j = frozen.indexOf(&b);
+    REQUIRE(frozen.firstDeparture(j, 0) == frozen.out_offsets[j + 1]);
+}
+
+TEST_CASE("Earliest arrival with the Connection Scan Algorithm") {
+    std::vector<Airport*> airports;
+
+    for (size_t i = 0; i < 4; i++) {
+        airports.push_back(new Airport());
+        airports.back()->airport_id = i + 1;
+    }
+
+    Graph graph;
+    for (Airport *a : airports) graph.createVertex(a);
+
+    // shortestPath labels B with the 800 flight (the newest on A's list) and misses the 720 connection
+    size_t routes[][4] = {{0, 1, 600, 700}, {1, 2, 720, 800}, {0, 1, 800, 1000}, {2, 3, 2300, 100}, {0, 3, 1000, 1200}, {2, 3, 900, 1300}};
+
+    std::vector<Flight> added;
+    for (auto &r : routes) {
+        Flight f;
+        f.departure = airports[r[0]];
+        f.arrival = airports[r[1]];
+        f.depart_time = r[2];
+        f.arrive_time = r[3];
+        f.flight_id = added.size();
+        graph.createEdge(f);
+        added.push_back(f);
+    }
+
+    Airport *a = airports[0], *b = airports[1], *c = airports[2], *d = airports[3];
+
+    REQUIRE_THROWS(graph.shortestPath(a, c, 0, 0));
+    REQUIRE(graph.earliestArrival(a, c, 0, 0) == std::vector<Flight>({added[0], added[1]}));
+
+    // too little time to connect at B, but the connection time does not apply at the start
+    REQUIRE_THROWS(graph.earliestArrival(a, c, 0, 30));
+    REQUIRE(graph.earliestArrival(a, b, 600, 30) == std::vector<Flight>({added[0]}));
+    REQUIRE(graph.earliestArrival(a, b, 601, 0) == std::vector<Flight>({added[2]}));
+
+    // the direct flight lands before the connection does, and the overnight flight is never used
+    REQUIRE(graph.earliestArrival(a, d, 0, 0) == std::vector<Flight>({added[4]}));
+    REQUIRE_THROWS(graph.earliestArrival(c, d, 1000, 0));
+
+    REQUIRE(graph.earliestArrival(a, a, 0, 0).empty());
+    REQUIRE_THROWS(graph.earliestArrival(d, a, 0, 0));
+
+    graph.freeze();
+    REQUIRE(graph.earliestArrival(a, c, 0, 0) == std::vector<Flight>({added[0], added[1]}));
+    REQUIRE(graph.earliestArrival(a, d, 0, 0) == std::vector<Flight>({added[4]}));
+    REQUIRE_THROWS(graph.earliestArrival(a, c, 0, 30));
+}
+
+TEST_CASE("Profile queries match earliest arrival at every departure time") {
+    std::vector<Airport*> airports;
+
+    for (size_t i = 0; i < 5; i++) {
+        airports.push_back(new Airport());
+        airports.back()->airport_id = i + 1;
+    }
+
+    Graph graph;
+    for (Airport *a : airports) graph.createVertex(a);
+
+    size_t routes[][4] = {{0, 1, 600, 700}, {1, 2, 720, 800}, {0, 1, 800, 1000}, {1, 2, 1030, 1100}, {0, 2, 900, 1200},
+                          {2, 3, 815, 900}, {2, 3, 1130, 1230}, {0, 3, 1100, 1400}, {3, 0, 1300, 1400}, {1, 4, 2300, 100}};
+
+    for (size_t i = 0; i < sizeof(routes) / sizeof(routes[0]); i++) {
+        Flight f;
+        f.departure = airports[routes[i][0]];
+        f.arrival = airports[routes[i][1]];
+        f.depart_time = routes[i][2];
+        f.arrive_time = routes[i][3];
+        f.flight_id = i;
+        graph.createEdge(f);
+    }
+
+    graph.freeze();
+
+    for (size_t connection : {0, 15, 30}) {
+        for (Airport *a : airports) {
+            for (Airport *b : airports) {
+                if (a == b) continue;
+
+                std::vector<std::vector<Flight>> journeys = graph.profile(a, b, connection);
+
+                for (size_t i = 1; i < journeys.size(); i++) {
+                    REQUIRE(journeys[i - 1].front().depart_time < journeys[i].front().depart_time);
+                    REQUIRE(journeys[i - 1].back().arrive_time < journeys[i].back().arrive_time);
+                }
+
+                // the first itinerary leaving at or after each time must arrive when earliestArrival does
+                for (size_t time = 500; time <= 1500; time += 5) {
+                    auto first = std::find_if(journeys.begin(), journeys.end(),
+                                              [time](const std::vector<Flight> &j) { return j.front().depart_time >= time; });
+
+                    try {
+                        std::vector<Flight> path = graph.earliestArrival(a, b, time, connection);
+                        REQUIRE(first != journeys.end());
+                        REQUIRE(first->back().arrive_time == path.back().arrive_time);
+                    } catch (int) {
+                        REQUIRE(first == journeys.end());
+                    }
+                }
+            }
+        }
+    }
+
+    // A -> D: 600 and 800 via B and C, then the 1100 direct flight (leaving at 900 via C misses the last C -> D flight)
+    std::vector<std::vector<Flight>> journeys = graph.profile(airports[0], airports[3], 0);
+    REQUIRE(journeys.size() == 3);
+    REQUIRE(journeys[0].size() == 3);
+    REQUIRE(journeys[0].back().arrive_time == 900);
+    REQUIRE(journeys[1].size() == 3);
+    REQUIRE(journeys[1].back().arrive_time == 1230);
+    REQUIRE(journeys[2].size() == 1);
+    REQUIRE(journeys[2].back().arrive_time == 1400);
+
+    REQUIRE(graph.profile(airports[4], airports[0], 0).empty());
+}
+
+TEST_CASE("Airports can be found by code") {
+    Graph graph;
+    std::string codes[] = {"ORD", "DEN", "ZZZ", "AAA", "x1"};
+
+    for (size_t i = 0; i < 5; i++) {
+        Airport *a = new Airport();
+        a->airport_id = i + 1;
+        a->airport_code = codes[i];
+        graph.createVertex(a);
+    }
+
+    for (size_t i = 0; i < 5; i++) {
+        REQUIRE(graph.getVertex(codes[i])->airport_id == i + 1);
+    }
+
+    REQUIRE_THROWS(graph.getVertex("SFO"));
+    REQUIRE_THROWS(graph.getVertex("ord"));
+    REQUIRE_THROWS(graph.getVertex(""));
+
+    std::vector<Airport*> found = graph.getVertices({"DEN", "SFO", "x1", "ORD"});
+    REQUIRE(found.size() == 4);
+    REQUIRE(found[0] == graph.getVertex("DEN"));
+    REQUIRE(found[1] == NULL);
+    REQUIRE(found[2] == graph.getVertex("x1"));
+    REQUIRE(found[3] == graph.getVertex("ORD"));
+
+    // copies have their own index
+    Graph copy = graph;
+    REQUIRE(copy.getVertex("ZZZ") != graph.getVertex("ZZZ"));
+    REQUIRE(copy.getVertex("ZZZ")->airport_id == 3);
+}
+
+TEST_CASE("Eccentricities match a breadth-first search from each airport") {
+    // more than 64 airports, so the search runs in more than one batch
+    std::vector<Airport*> airports;
+    Graph graph;
+
+    for (size_t i = 0; i < 150; i++) {
+        airports.push_back(new Airport());
+        airports.back()->airport_id = i + 1;
+        graph.createVertex(airports.back());
+    }
+
+    // a long chain, so some airports are many flights apart, plus a few random shortcuts
+    size_t id = 0;
+    unsigned seed = 7;
+    for (size_t i = 0; i + 1 < 140; i++) {
+        size_t to = i + 1;
+        if (i % 9 == 0) {
+            seed = seed * 1103515245 + 12345;
+            to = (seed >> 8) % 140;
+        }
+
+        Flight f;
+        f.departure = airports[i];
+        f.arrival = airports[to];
+        f.flight_id = id++;
+        graph.createEdge(f);
+    }
+
+    for (bool freeze : {false, true}) {
+        if (freeze) graph.freeze();
+
+        data::Eccentricities all = graph.eccentricities();
+        REQUIRE(all.airports.size() == airports.size());
+
+        size_t diameter = 0;
+        size_t radius = SIZE_MAX;
+
+        for (size_t i = 0; i < airports.size(); i++) {
+            REQUIRE(all.airports[i] == airports[i]);
+            REQUIRE(all.eccentricity[i] == graph.stopCount(airports[i]));
+
+            std::vector<Airport*> furthest = graph.findFurthestAirports(airports[i]);
+            std::sort(furthest.begin(), furthest.end(), data::AirportIdLess());
+            REQUIRE(all.furthest[i] == furthest);
+
+            diameter = std::max(diameter, all.eccentricity[i]);
+            if (all.eccentricity[i] > 0) radius = std::min(radius, all.eccentricity[i]);
+        }
+
+        REQUIRE(all.diameter == diameter);
+        REQUIRE(all.radius == radius);
+        REQUIRE(diameter > 10);
+    }
+}
+
+TEST_CASE("Furthest airports are the same searching top-down or bottom-up") {
+    // a few hubs with flights to and from most airports, so the middle levels are searched bottom-up,
+    // and a chain of small airports off the last one, so the last levels are searched top-down again
+    std::vector<Airport*> airports;
+    Graph graph;
+
+    for (size_t i = 0; i < 300; i++) {
+        airports.push_back(new Airport());
+        airports.back()->airport_id = 300 - i;
+        graph.createVertex(airports.back());
+    }
+
+    size_t id = 0;
+    auto addFlight = [&](size_t from, size_t to) {
+        Flight f;
+        f.departure = airports[from];
+        f.arrival = airports[to];
+        f.flight_id = id++;
+        graph.createEdge(f);
+    };
+
+    for (size_t hub = 0; hub < 4; hub++) {
+        for (size_t i = 4; i < 280; i++) {
+            if ((i + hub) % 3 != 0) addFlight(hub, i);
+            if ((i + hub) % 5 != 0) addFlight(i, hub);
+        }
+    }
+
+    for (size_t i = 279; i + 1 < 300; i++) addFlight(i, i + 1);
+
+    std::vector<std::vector<Airport*>> before;
+    std::vector<size_t> before_stops;
+
+    for (Airport *a : airports) {
+        size_t stops;
+        before.push_back(graph.findFurthestAirports(a, &stops));
+        before_stops.push_back(stops);
+
+        REQUIRE(stops == graph.stopCount(a));
+        REQUIRE(std::is_sorted(before.back().begin(), before.back().end(), data::AirportIdLess()));
+    }
+
+    graph.freeze();
+
+    for (size_t i = 0; i < airports.size(); i++) {
+        size_t stops;
+        REQUIRE(graph.findFurthestAirports(airports[i], &stops) == before[i]);
+        REQUIRE(stops == before_stops[i]);
+    }
+
+    REQUIRE(before_stops[0] == 23);
+    REQUIRE(before[0] == std::vector<Airport*>(1, airports[299]));
+}
+
+TEST_CASE("The stop table matches a search for every pair of airports") {
+    std::vector<Airport*> airports;
+    Graph graph;
+
+    for (size_t i = 0; i < 100; i++) {
+        airports.push_back(new Airport());
+        airports.back()->airport_id = i + 1;
+        graph.createVertex(airports.back());
+    }
+
+    // a chain with shortcuts, leaving the last few airports with no flights in
+    size_t id = 0;
+    unsigned seed = 11;
+    for (size_t i = 0; i + 1 < 95; i++) {
+        seed = seed * 1103515245 + 12345;
+
+        Flight f;
+        f.departure = airports[i];
+        f.arrival = airports[i % 7 == 0 ? (seed >> 8) % 95 : i + 1];
+        f.flight_id = id++;
+        graph.createEdge(f);
+    }
+
+    // answers from searching each pair
+    std::vector<int> expected;
+    for (Airport *a : airports) {
+        for (Airport *b : airports) {
+            try {
+                expected.push_back(graph.stops(a, b));
+            } catch (int) {
+                expected.push_back(-1);
+            }
+        }
+    }
+
+    REQUIRE(expected[0] == 0);
+    REQUIRE(expected[99] == -1);
+
+    graph.computeStopTable(3);
+    REQUIRE(graph.isFrozen());
+    REQUIRE(graph.hasStopTable());
+
+    std::vector<uint8_t> table = graph.getStopTable();
+    graph.computeStopTable(1);
+    REQUIRE(graph.getStopTable() == table);
+
+    size_t k = 0;
+    for (size_t i = 0; i < airports.size(); i++) {
+        for (size_t j = 0; j < airports.size(); j++, k++) {
+            if (expected[k] == -1) {
+                REQUIRE_THROWS(graph.stops(airports[i], airports[j]));
+            } else {
+                REQUIRE(graph.stops(airports[i], airports[j]) == (size_t) expected[k]);
+            }
+        }
+
+        // the furthest airport in each row is as far as stopCount says
+        size_t furthest = 0;
+        for (size_t j = 0; j < airports.size(); j++) {
+            if (table[i * 100 + j] != data::FrozenGraph::NO_ROUTE) furthest = std::max<size_t>(furthest, table[i * 100 + j]);
+        }
+
+        REQUIRE(furthest == graph.stopCount(airports[i]));
+    }
+
+    // copies keep the table, new flights drop it
+    Graph copy = graph;
+    REQUIRE(copy.getStopTable() == table);
+
+    REQUIRE_THROWS(graph.setStopTable(std::vector<uint8_t>(10)));
+
+    Flight extra;
+    extra.departure = airports[99];
+    extra.arrival = airports[0];
+    extra.flight_id = id++;
+    graph.createEdge(extra);
+
+    REQUIRE_FALSE(graph.hasStopTable());
+    REQUIRE(graph.stops(airports[99], airports[0]) == 1);
+    REQUIRE_THROWS(graph.stops(airports[98], airports[0]));
+}
+
+TEST_CASE("Arenas keep objects in place until they are cleared") {
+    data::Arena<Airport> arena;
+    std::vector<Airport*> created;
+
+    for (size_t i = 0; i < 1000; i++) {
+        created.push_back(arena.create());
+        created.back()->airport_id = i;
+        created.back()->airport_code = std::string(40, 'A' + i % 26);
+    }
+
+    REQUIRE(arena.size() == 1000);
+    REQUIRE(arena.allocations() < 10);
+
+    for (size_t i = 0; i < 1000; i++) {
+        REQUIRE(arena.owns(created[i]));
+        REQUIRE(created[i]->airport_id == i);
+    }
+
+    Airport outside;
+    REQUIRE_FALSE(arena.owns(&outside));
+
+    // another arena's airports move over without moving in memory
+    data::Arena<Airport> other;
+    Airport *moved = other.create();
+    moved->airport_id = 5000;
+
+    arena.splice(other);
+    REQUIRE(arena.size() == 1001);
+    REQUIRE(other.size() == 0);
+    REQUIRE(arena.owns(moved));
+    REQUIRE(moved->airport_id == 5000);
+
+    // a graph frees the airports it creates along with itself
+    Graph *graph = new Graph();
+    Airport *a = graph->createVertex(1, "ORD");
+    graph->createVertex(new Airport());
+
+    REQUIRE(graph->getVertex("ORD") == a);
+    delete graph;
+
+    arena.clear();
+    REQUIRE(arena.size() == 0);
+    REQUIRE(arena.allocations() == 0);
+}
+
+TEST_CASE("Carriers are shared and counted per graph") {
+    data::Carrier ua("UA");
+    data::Carrier aa = std::string("AA");
+
+    REQUIRE(ua == data::Carrier("UA"));
+    REQUIRE(ua != aa);
+    REQUIRE(ua.code() == "UA");
+    REQUIRE(data::Carrier().code() == "");
+    REQUIRE(data::Carrier::fromId(ua.id()) == ua);
+
+    data::Carrier found;
+    REQUIRE(data::Carrier::find("AA", found));
+    REQUIRE(found == aa);
+    REQUIRE_FALSE(data::Carrier::find("never used", found));
+
+    Graph graph;
+    Airport *a = graph.createVertex(1, "AAA");
+    Airport *b = graph.createVertex(2, "BBB");
+
+    for (size_t i = 0; i < 5; i++) {
+        Flight f;
+        f.departure = i % 2 ? a : b;
+        f.arrival = i % 2 ? b : a;
+        f.airline = i < 3 ? ua : aa;
+        f.flight_id = i;
+        graph.createEdge(f);
+    }
+
+    REQUIRE(graph.flightCount(ua) == 3);
+    REQUIRE(graph.flightCount(aa) == 2);
+    REQUIRE(graph.flightCount(data::Carrier()) == 0);
+
+    // freezing and copying keep the carriers and their counts
+    graph.freeze();
+    REQUIRE(graph.getEdge(4).airline == aa);
+    REQUIRE(graph.flightCount(ua) == 3);
+
+    Graph copy = graph;
+    REQUIRE(copy.flightCount(aa) == 2);
+    REQUIRE(copy.getEdge(0).airline.code() == "UA");
+
+    // assigning over a graph with flights counts only the new ones
+    Graph assigned;
+    Airport *c = assigned.createVertex(3, "CCC");
+    Flight f;
+    f.departure = c;
+    f.arrival = c;
+    f.airline = ua;
+    f.flight_id = 9;
+    assigned.createEdge(f);
+
+    assigned = graph;
+    REQUIRE(assigned.flightCount(ua) == 3);
+    REQUIRE(assigned.flightCount(aa) == 2);
+    REQUIRE(assigned.getAirports().size() == 2);
+    REQUIRE(assigned.getFlights().size() == 5);
+    REQUIRE_THROWS(assigned.getVertex("CCC"));
+
+    assigned = copy;
+    REQUIRE(assigned.flightCount(ua) == 3);
+}
+
+TEST_CASE("Moving a graph keeps its airports and flights") {
+    Graph graph;
+    Airport *a = graph.createVertex(1, "AAA");
+    Airport *b = graph.createVertex(2, "BBB");
+
+    Flight f;
+    f.departure = a;
+    f.arrival = b;
+    f.flight_id = 0;
+    graph.createEdge(f);
+
+    // moving an unfrozen graph hands over the same airports
+    Graph moved = std::move(graph);
+    REQUIRE(moved.getVertex("AAA") == a);
+    REQUIRE(moved.areAdjacent(a, b));
+    REQUIRE(graph.getAirports().empty());
+    REQUIRE(graph.getFlights().empty());
+
+    moved.freeze();
+    moved.computeStopTable();
+
+    // moving over a graph frees what it held and takes the frozen graph and its table
+    Graph other;
+    other.createVertex(3, "CCC");
+    other = std::move(moved);
+
+    REQUIRE(other.isFrozen());
+    REQUIRE(other.getVertex(1) == a);
+    REQUIRE_THROWS(other.getVertex("CCC"));
+    REQUIRE(other.stops(a, b) == 1);
+    REQUIRE(other.getEdge(0).arrival == b);
+    REQUIRE(moved.getAirports().empty());
+    REQUIRE_FALSE(moved.hasStopTable());
+}
+
+TEST_CASE("Neighbour visitors match the flight lists frozen or not") {
+    Graph graph;
+    std::vector<Airport*> airports;
+
+    // ids out of creation order, so the visitors have to sort destinations themselves
+    for (size_t i = 0; i < 30; i++) airports.push_back(graph.createVertex((i * 7) % 30, "A" + std::to_string(i)));
+
+    // repeated routes, so the distinct visitors have duplicates to skip
+    size_t id = 0;
+    for (size_t i = 0; i < 30; i++) {
+        for (size_t j = 0; j < 30; j++) {
+            if ((i * j) % 7 != 1) continue;
+
+            for (size_t k = 0; k < 1 + (i + j) % 3; k++) {
+                Flight f;
+                f.departure = airports[i];
+                f.arrival = airports[j];
+                f.flight_id = id++;
+                graph.createEdge(f);
+            }
+        }
+    }
+
+    auto check = [&]() {
+        for (Airport *a : airports) {
+            std::vector<Airport*> destinations;
+            std::vector<Airport*> origins;
+            graph.forEachDestination(a, [&](Airport *b) { destinations.push_back(b); });
+            graph.forEachOrigin(a, [&](Airport *b) { origins.push_back(b); });
+
+            REQUIRE(destinations == graph.outgoingNodes(a));
+            REQUIRE(origins == graph.incomingNodes(a));
+
+            // the same airports as the flights, each once and in airport_id order
+            std::set<Airport*, data::AirportIdLess> arrivals;
+            std::set<Airport*, data::AirportIdLess> departures;
+            graph.forEachDeparture(a, [&](const Flight &f) {
+                REQUIRE(f.departure == a);
+                arrivals.insert(f.arrival);
+            });
+            graph.forEachArrival(a, [&](const Flight &f) {
+                REQUIRE(f.arrival == a);
+                departures.insert(f.departure);
+            });
+
+            REQUIRE(destinations == std::vector<Airport*>(arrivals.begin(), arrivals.end()));
+            REQUIRE(origins == std::vector<Airport*>(departures.begin(), departures.end()));
+
+            for (Airport *b : airports) {
+                REQUIRE(graph.areAdjacent(a, b) == (arrivals.count(b) > 0 || departures.count(b) > 0));
+            }
+        }
+    };
+
+    check();
+
+    graph.freeze();
+    check();
+
+    // thawing rebuilds the lists from the frozen graph
+    Flight extra;
+    extra.departure = airports[0];
+    extra.arrival = airports[1];
+    extra.flight_id = id++;
+    graph.createEdge(extra);
+    REQUIRE_FALSE(graph.isFrozen());
+    check();
+}
+
+TEST_CASE("Non-adjacent pairs are every pair with no flight either way") {
+    // more than 64 airports, so the adjacency rows span several words
+    Graph graph;
+    std::vector<Airport*> airports;
+
+    for (size_t i = 0; i < 150; i++) airports.push_back(graph.createVertex(i, "N" + std::to_string(i)));
+
+    size_t id = 0;
+    for (size_t i = 0; i < 150; i++) {
+        for (size_t j = 0; j < 150; j++) {
+            if (i == j || (i * 31 + j * 17) % 11 != 0) continue;
+
+            Flight f;
+            f.departure = airports[i];
+            f.arrival = airports[j];
+            f.flight_id = id++;
+            graph.createEdge(f);
+        }
+    }
+
+    std::vector<std::pair<Airport*, Airport*>> expected;
+    for (size_t i = 0; i < 150; i++) {
+        for (size_t j = i + 1; j < 150; j++) {
+            if (!graph.areAdjacent(airports[i], airports[j])) expected.push_back(std::make_pair(airports[i], airports[j]));
+        }
+    }
+
+    REQUIRE(!expected.empty());
+
+    auto pairs = [&graph]() {
+        std::vector<std::pair<Airport*, Airport*>> found;
+        graph.forEachNonAdjacentPair([&found](Airport *a, Airport *b) { found.push_back(std::make_pair(a, b)); });
+        return found;
+    };
+
+    // unfrozen, then frozen with the adjacency bits
+    REQUIRE(pairs() == expected);
+
+    graph.freeze();
+    REQUIRE(pairs() == expected);
+
+    for (size_t i = 0; i < 150; i++) {
+        for (size_t j = 0; j < 150; j++) {
+            bool adjacent = i != j && ((i * 31 + j * 17) % 11 == 0 || (j * 31 + i * 17) % 11 == 0);
+            REQUIRE(graph.areAdjacent(airports[i], airports[j]) == adjacent);
+        }
+    }
+
+    // the same pairs from the neighbour lists alone
+    std::unordered_map<size_t, data::IncidentEdgeList> vertexList;
+    std::vector<Flight> flights = graph.getFlights();
+
+    for (Airport *a : airports) vertexList[a->airport_id].airport = a;
+    for (Flight &f : flights) {
+        vertexList[f.departure->airport_id].departing.push_back(&f);
+        vertexList[f.arrival->airport_id].arriving.push_back(&f);
+    }
+
+    data::FrozenGraph frozen(vertexList);
+    REQUIRE(frozen.adjacency.size() == 150 * 3);
+
+    frozen.adjacency.clear();
+
+    std::vector<std::pair<Airport*, Airport*>> from_lists;
+    frozen.forEachNonAdjacent([&](uint32_t i, uint32_t j) { from_lists.push_back(std::make_pair(frozen.airports[i], frozen.airports[j])); });
+    REQUIRE(from_lists == expected);
+    REQUIRE(frozen.adjacent(frozen.indexOf(airports[0]), frozen.indexOf(airports[0])) == false);
+}
+
+TEST_CASE("Unmet demand scores pairs one stop apart the same on any number of threads") {
+    Graph graph;
+    std::vector<Airport*> airports;
+
+    for (size_t i = 0; i < 40; i++) airports.push_back(graph.createVertex(100 - i, "U" + std::to_string(i)));
+
+    // a sparse network, some routes flown daily, with distances
+    size_t id = 0;
+    for (size_t i = 0; i < 40; i++) {
+        for (size_t j = 0; j < 40; j++) {
+            if (i == j || (i * 13 + j * 7) % 17 != 0) continue;
+
+            Flight f;
+            f.departure = airports[i];
+            f.arrival = airports[j];
+            f.flight_id = id++;
+            f.distance = 100 + 37 * ((i + j) % 23);
+            f.frequency = (i + j) % 3 ? data::MONTHLY : data::DAILY;
+            graph.createEdge(f);
+        }
+    }
+
+    graph.freeze();
+
+    std::vector<data::UnmetDemand> all = graph.unmetDemand(SIZE_MAX, 1);
+    REQUIRE(!all.empty());
+
+    // every candidate is one stop apart, and every pair one stop apart is a candidate
+    graph.computeStopTable();
+    size_t candidates = 0;
+
+    auto oneStop = [&graph](Airport *from, Airport *to) {
+        try {
+            return graph.stops(from, to) == 2;
+        } catch (int) {
+            return false;
+        }
+    };
+
+    for (size_t i = 0; i < 40; i++) {
+        for (size_t j = i + 1; j < 40; j++) {
+            if (!graph.areAdjacent(airports[i], airports[j]) && (oneStop(airports[i], airports[j]) || oneStop(airports[j], airports[i]))) {
+                candidates++;
+            }
+        }
+    }
+
+    REQUIRE(all.size() == candidates);
+
+    std::vector<std::pair<Airport*, double>> ranking = graph.rankAirports(data::RankOptions());
+
+    for (size_t k = 0; k < all.size(); k++) {
+        const data::UnmetDemand &pair = all[k];
+        REQUIRE(pair.first->airport_id < pair.second->airport_id);
+        REQUIRE_FALSE(graph.areAdjacent(pair.first, pair.second));
+        if (k > 0) REQUIRE(all[k - 1].score >= pair.score);
+
+        // the shortest one-stop distance and the itineraries through every stop, counted from the flights
+        size_t distance = SIZE_MAX;
+        size_t connections = 0;
+
+        for (Airport *stop : airports) {
+            for (int way = 0; way < 2; way++) {
+                Airport *from = way ? pair.second : pair.first;
+                Airport *to = way ? pair.first : pair.second;
+
+                size_t first_distance = SIZE_MAX, second_distance = SIZE_MAX, first_count = 0, second_count = 0;
+
+                graph.forEachDeparture(from, [&](const Flight &f) {
+                    if (f.arrival != stop) return;
+                    first_distance = std::min(first_distance, f.distance);
+                    first_count += f.frequency == data::DAILY ? 28 : 1;
+                });
+
+                graph.forEachDeparture(stop, [&](const Flight &f) {
+                    if (f.arrival != to) return;
+                    second_distance = std::min(second_distance, f.distance);
+                    second_count += f.frequency == data::DAILY ? 28 : 1;
+                });
+
+                if (first_count == 0 || second_count == 0) continue;
+
+                distance = std::min(distance, first_distance + second_distance);
+                connections += std::min(first_count, second_count);
+            }
+        }
+
+        REQUIRE(pair.distance == distance);
+        REQUIRE(pair.connections == connections);
+
+        double mass_first = 0, mass_second = 0;
+        for (const std::pair<Airport*, double> &ranked : ranking) {
+            if (ranked.first == pair.first) mass_first = ranked.second * 40;
+            if (ranked.first == pair.second) mass_second = ranked.second * 40;
+        }
+
+        double friction = 1 + distance / 1000.0;
+        REQUIRE(pair.score == Approx(mass_first * mass_second / (friction * friction * std::log2(2.0 + connections))));
+    }
+
+    // the top pairs do not depend on the threads or on freezing
+    std::vector<data::UnmetDemand> top = graph.unmetDemand(15, 4);
+    REQUIRE(top.size() == 15);
+
+    for (size_t k = 0; k < top.size(); k++) {
+        REQUIRE(top[k].first == all[k].first);
+        REQUIRE(top[k].second == all[k].second);
+    }
+
+    Flight extra;
+    extra.departure = all.back().first;
+    extra.arrival = all.back().second;
+    extra.flight_id = id++;
+    graph.createEdge(extra);
+
+    // the pair with a flight now is no longer a candidate
+    for (const data::UnmetDemand &pair : graph.unmetDemand(SIZE_MAX, 3)) {
+        REQUIRE_FALSE((pair.first == extra.departure && pair.second == extra.arrival));
+    }
+
+    REQUIRE(graph.unmetDemand(0).empty());
+}
+
+TEST_CASE("Freezing rejects times that do not fit a flight record") {
+    Graph graph;
+    Airport *a = graph.createVertex(1, "AAA");
+    Airport *b = graph.createVertex(2, "BBB");
+
+    Flight f;
+    f.departure = a;
+    f.arrival = b;
+    f.depart_time = 23 * 60 + 59;
+    f.arrive_time = 65535;
+    f.flight_id = 0;
+    graph.createEdge(f);
+
+    graph.freeze();
+    REQUIRE(graph.getEdge(0).arrive_time == 65535);
+
+    // seconds from midnight instead of minutes
+    f.depart_time = 86399;
+    f.flight_id = 1;
+    graph.createEdge(f);
+
+    REQUIRE_THROWS(graph.freeze());
+    REQUIRE_FALSE(graph.isFrozen());
+    REQUIRE(graph.getEdge(1).depart_time == 86399);
+    REQUIRE(graph.areAdjacent(a, b));
+}
+
+TEST_CASE("Freezing rejects distances and airtimes that do not fit a flight record") {
+    Graph graph;
+    Airport *a = graph.createVertex(1, "AAA");
+    Airport *b = graph.createVertex(2, "BBB");
+
+    Flight f;
+    f.departure = a;
+    f.arrival = b;
+    f.distance = 65535;
+    f.airtime = 65535;
+    f.flight_id = 0;
+    graph.createEdge(f);
+
+    graph.freeze();
+    REQUIRE(graph.getEdge(0).distance == 65535);
+    REQUIRE(graph.getEdge(0).airtime == 65535);
+
+    // clamping would store a wrong distance, so the graph is left as it is
+    f.distance = 70000;
+    f.flight_id = 1;
+    graph.createEdge(f);
+
+    REQUIRE_THROWS(graph.freeze());
+    REQUIRE_FALSE(graph.isFrozen());
+    REQUIRE(graph.getEdge(1).distance == 70000);
+
+    f.distance = 500;
+    f.airtime = 65536;
+    f.flight_id = 2;
+    Graph other;
+    other.createVertex(1, "AAA");
+    other.createVertex(2, "BBB");
+    f.departure = other.getVertex(1);
+    f.arrival = other.getVertex(2);
+    other.createEdge(f);
+
+    REQUIRE_THROWS(other.freeze());
+    REQUIRE_FALSE(other.isFrozen());
+    REQUIRE(other.getEdge(2).airtime == 65536);
+}
+
+TEST_CASE("Copies outlive the graph they were copied from") {
+    for (int frozen = 0; frozen < 2; frozen++) {
+        Graph *source = new Graph();
+        Airport *a = source->createVertex(1, "AAA");
+        Airport *b = source->createVertex(2, "BBB");
+        Airport *c = source->createVertex(3, "CCC");
+
+        for (size_t i = 0; i < 3; i++) {
+            Flight f;
+            f.departure = i == 2 ? b : a;
+            f.arrival = i == 0 ? b : c;
+            f.flight_id = i;
+            source->createEdge(f);
+        }
+
+        if (frozen) source->freeze();
+
+        Graph *copy = new Graph(*source);
+        Airport *copied = copy->getVertex("AAA");
+        REQUIRE(copied != a);
+
+        // every flight and neighbour list refers to the copy's own airports
+        for (const Flight &f : copy->getFlights()) {
+            REQUIRE(f.departure == copy->getVertex(f.departure->airport_id));
+            REQUIRE(f.arrival == copy->getVertex(f.arrival->airport_id));
+        }
+
+        delete source;
+
+        std::vector<Airport*> destinations = copy->outgoingNodes(copied);
+        REQUIRE(destinations.size() == 2);
+        REQUIRE(destinations[0]->airport_code == "BBB");
+        REQUIRE(destinations[1]->airport_code == "CCC");
+        REQUIRE(copy->incomingNodes(copy->getVertex("CCC"))[1]->airport_code == "BBB");
+        REQUIRE(copy->areAdjacent(copy->getVertex("BBB"), copy->getVertex("CCC")));
+
+        copy->freeze();
+        REQUIRE(copy->outgoingNodes(copied)[1]->airport_code == "CCC");
+
+        delete copy;
+    }
+}
@@ -3,7 +3,14 @@
 
 #include "../graph.h"
 #include "../loadfile.h"
+#include "../scan.h"
+#include "../snapshot.h"
+#include "../utils.h"
 
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
 #include <string>
 #include <vector>
 #include <iostream>
@@ -11,6 +18,7 @@
 using data::Graph;
 using io::openFile;
 using io::loadFile;
+using io::loadFileMapped;
 
 // Tests for loading in Graph data from files
 // To build and run this, run the following commands in Terminal:
@@ -28,8 +36,7 @@ TEST_CASE("Full test of loading from file", "[id=2]") {
     std::ifstream f = openFile(file);
 
     try{
-        Graph* flights = loadFile(f);
-        delete flights;
+        std::unique_ptr<Graph> flights = loadFile(f);
     } catch (int) {
         FAIL("Some error occurred");
     }
@@ -41,7 +48,7 @@ TEST_CASE("Full test of loading from file", "[id=2]") {
 TEST_CASE("Files other than july 2019 load successfully", "[id=3]") {
     std::string file = "data/mar-1990-data.csv";
     try{
-        Graph* flights = loadFile(file);
+        std::unique_ptr<Graph> flights = loadFile(file);
 
         Airport *one = flights->getVertex("EWR");
         Airport *two = flights->getVertex("BOS");
@@ -57,11 +64,344 @@ TEST_CASE("Files other than july 2019 load successfully", "[id=3]") {
         CHECK(flights->areAdjacent(flights->getVertex(13891), flights->getVertex(13930)));
         CHECK(flights->areAdjacent(flights->getVertex(13891), flights->getVertex(10800)));
         CHECK(flights->areAdjacent(one, two));
-        delete flights;
 
     } catch (int) {
         FAIL("File could not be loaded");
     }
 }
 
+TEST_CASE("Memory-mapped loader matches the stream loader") {
+    std::string file = "data/july-2019-data.csv";
+
+    REQUIRE_THROWS(loadFileMapped("notCsv.pdf"));
+    REQUIRE_THROWS(loadFileMapped("nonexistentFile.csv"));
+
+    std::unique_ptr<Graph> streamed = loadFile(file);
+    std::unique_ptr<Graph> mapped = loadFileMapped(file);
+
+    REQUIRE(streamed->getAirports().size() == mapped->getAirports().size());
+    REQUIRE(streamed->getFlights().size() == mapped->getFlights().size());
+
+    for (Airport *a : streamed->getAirports()) {
+        REQUIRE(mapped->getVertex(a->airport_id)->airport_code == a->airport_code);
+    }
+
+    for (Flight f : streamed->getFlights()) {
+        Flight other = mapped->getEdge(f.flight_id);
+
+        REQUIRE(other.departure->airport_id == f.departure->airport_id);
+        REQUIRE(other.arrival->airport_id == f.arrival->airport_id);
+        REQUIRE(other.depart_time == f.depart_time);
+        REQUIRE(other.arrive_time == f.arrive_time);
+        REQUIRE(other.weekday == f.weekday);
+        REQUIRE(other.airline == f.airline);
+        REQUIRE(other.distance == f.distance);
+        REQUIRE(other.airtime == f.airtime);
+        REQUIRE(other.frequency == f.frequency);
+    }
+}
+
+TEST_CASE("Parallel loading is deterministic") {
+    std::string file = "data/july-2019-data.csv";
+
+    std::unique_ptr<Graph> single = loadFileMapped(file, 1);
+    std::unique_ptr<Graph> parallel = loadFileMapped(file, 4);
+
+    REQUIRE(single->getAirports().size() == parallel->getAirports().size());
+    REQUIRE(single->getFlights().size() == parallel->getFlights().size());
+
+    for (Flight f : single->getFlights()) {
+        Flight other = parallel->getEdge(f.flight_id);
+
+        REQUIRE(other.departure->airport_id == f.departure->airport_id);
+        REQUIRE(other.arrival->airport_id == f.arrival->airport_id);
+        REQUIRE(other.depart_time == f.depart_time);
+        REQUIRE(other.weekday == f.weekday);
+        REQUIRE(other.frequency == f.frequency);
+    }
+}
+
+TEST_CASE("Every field scanning kernel splits rows the same way") {
+    std::string text = "1,2019-07-01,\"9E\",10397,\"ATL\",11921,\"GJT\",\"1837\",\"2036\",253.00,1557.00,\n"
+                       "3,\"quoted, with a comma\",,\"\",,,\"\",\"\",\"\",,,\n"
+                       "no newline at the end";
+
+    for (utils::ScanKernel kernel : {utils::SCAN_SCALAR, utils::SCAN_SSE2, utils::SCAN_AVX2}) {
+        if (!utils::setScanKernel(kernel)) continue;
+
+        std::string_view rest = text;
+        std::string_view fields[11];
+        size_t consumed;
+
+        REQUIRE(utils::splitFields(rest, fields, 11, consumed) == 12);
+        REQUIRE(fields[2] == "\"9E\"");
+        REQUIRE(fields[10] == "1557.00");
+        rest = rest.substr(consumed);
+
+        REQUIRE(utils::splitFields(rest, fields, 11, consumed) == 12);
+        REQUIRE(fields[1] == "\"quoted, with a comma\"");
+        REQUIRE(fields[2] == "");
+        rest = rest.substr(consumed);
+
+        REQUIRE(utils::splitFields(rest, fields, 11, consumed) == 1);
+        REQUIRE(fields[0] == "no newline at the end");
+        REQUIRE(consumed == rest.size());
+    }
+}
+
+TEST_CASE("Numbers are parsed the way std::stoi parses them") {
+    REQUIRE(utils::parseInt("1557.00") == 1557);
+    REQUIRE(utils::parseInt("  -42,") == -42);
+    REQUIRE(utils::parseInt("2147483647") == 2147483647);
+    REQUIRE(utils::parseInt("-2147483648") == -2147483648L);
+
+    REQUIRE_THROWS_AS(utils::parseInt(""), std::invalid_argument);
+    REQUIRE_THROWS_AS(utils::parseInt("\"9E\""), std::invalid_argument);
+    REQUIRE_THROWS_AS(utils::parseInt("2147483648"), std::out_of_range);
+    REQUIRE_THROWS_AS(utils::parseInt("-2147483649"), std::out_of_range);
+    REQUIRE_THROWS_AS(utils::parseInt("99999999999999999999999"), std::out_of_range);
+    REQUIRE_THROWS_AS(std::stoi("99999999999999999999999"), std::out_of_range);
+}
+
+TEST_CASE("Both loaders reject a number that does not fit") {
+    std::string file = "data/test-overflow.csv";
+
+    {
+        std::ofstream out(file);
+        out << "\"DAY_OF_WEEK\",\"FL_DATE\",\"OP_UNIQUE_CARRIER\",\"ORIGIN_AIRPORT_ID\",\"ORIGIN\",\"DEST_AIRPORT_ID\",\"DEST\","
+               "\"CRS_DEP_TIME\",\"CRS_ARR_TIME\",\"AIR_TIME\",\"DISTANCE\",\n";
+        for (int i = 0; i < 20; i++) {
+            out << "1,2019-07-01,\"9E\",10397,\"ATL\",11921,\"GJT\",\"1837\",\"2036\",253.00,1557.00,\n";
+        }
+        // the last row, so a parallel load meets it on a worker thread
+        out << "1,2019-07-01,\"9E\",10397,\"ATL\",11921,\"GJT\",\"1837\",\"2036\",253.00,99999999999.00,\n";
+    }
+
+    REQUIRE_THROWS_AS(loadFile(file), std::out_of_range);
+    REQUIRE_THROWS_AS(loadFileMapped(file, 1), std::out_of_range);
+    REQUIRE_THROWS_AS(loadFileMapped(file, 4), std::out_of_range);
+
+    std::remove(file.c_str());
+}
+
+// Parse a file into the staging maps used by the merge phase.
+std::map<std::pair<Airport*, Airport*>, std::vector<Flight>> stageFlights(const std::string &file, data::Arena<Airport> &arena,
+                                                                          std::map<size_t, Airport*> &airports) {
+    io::MappedFile mapped(file);
+    std::string_view contents = mapped.view();
+
+    io::ParsedChunk chunk;
+    io::parseChunk(contents.substr(contents.find('\n') + 1), chunk);
+
+    std::map<std::pair<Airport*, Airport*>, std::vector<Flight>> flights;
+    size_t flight_count = 0;
+    io::mergeChunk(chunk, arena, airports, flights, flight_count);
+
+    return flights;
+}
+
+// Require two staging maps to hold the same flights in the same order.
+void requireSameFlights(const std::map<std::pair<Airport*, Airport*>, std::vector<Flight>> &expected,
+                        const std::map<std::pair<Airport*, Airport*>, std::vector<Flight>> &actual) {
+    REQUIRE(expected.size() == actual.size());
+
+    for (auto i = expected.begin(), j = actual.begin(); i != expected.end(); i++, j++) {
+        REQUIRE(i->first == j->first);
+        REQUIRE(i->second.size() == j->second.size());
+
+        for (size_t k = 0; k < i->second.size(); k++) {
+            REQUIRE(i->second[k].flight_id == j->second[k].flight_id);
+            REQUIRE(i->second[k].frequency == j->second[k].frequency);
+        }
+    }
+}
+
+TEST_CASE("mergeSchedules matches mergeFlights on a week of similar flights") {
+    Airport a, b;
+    a.airport_id = 1;
+    b.airport_id = 2;
+
+    // The same flight three times on each weekday, plus twice on Monday at another time.
+    std::map<std::pair<Airport*, Airport*>, std::vector<Flight>> flights;
+    std::vector<Flight> &route = flights[std::pair<Airport*, Airport*>(&a, &b)];
+
+    for (size_t week = 0; week < 3; week++) {
+        for (size_t day = 1; day <= 7; day++) {
+            Flight f;
+            f.departure = &a;
+            f.arrival = &b;
+            f.flight_id = route.size();
+            f.weekday = day;
+            f.airline = "AA";
+            f.depart_time = 600;
+            f.frequency = data::MONTHLY;
+            route.push_back(f);
+        }
+
+        if (week < 2) {
+            Flight f = route.back();
+            f.flight_id = route.size();
+            f.weekday = 1;
+            f.depart_time = 900;
+            route.push_back(f);
+        }
+    }
+
+    std::map<std::pair<Airport*, Airport*>, std::vector<Flight>> merged = io::mergeSchedules(flights, 3, 6);
+
+    std::map<std::pair<Airport*, Airport*>, std::vector<Flight>> expected = io::mergeFlights(flights, data::WEEKLY, 3);
+    expected = io::mergeFlights(expected, data::DAILY, 6);
+
+    requireSameFlights(expected, merged);
+
+    // mergeFlights stops promoting once fewer than 6 weekly flights are left unpromoted.
+    std::vector<Flight> &out = merged[std::pair<Airport*, Airport*>(&a, &b)];
+    REQUIRE(out.size() == 8);
+    REQUIRE(out[0].frequency == data::DAILY);
+    REQUIRE(out[1].frequency == data::WEEKLY);
+    REQUIRE(out[2].frequency == data::WEEKLY);
+    REQUIRE(out[7].frequency == data::MONTHLY);
+}
+
+TEST_CASE("mergeSchedules matches mergeFlights on a full file") {
+    data::Arena<Airport> arena;
+    std::map<size_t, Airport*> airports;
+    std::map<std::pair<Airport*, Airport*>, std::vector<Flight>> flights = stageFlights("data/mar-1990-data.csv", arena, airports);
+
+    std::map<std::pair<Airport*, Airport*>, std::vector<Flight>> expected = io::mergeFlights(flights, data::WEEKLY, 3);
+    expected = io::mergeFlights(expected, data::DAILY, 6);
+
+    requireSameFlights(expected, io::mergeSchedules(flights, 3, 6));
+}
+
+TEST_CASE("Snapshots hold the same graph as the file") {
+    std::string file = "data/mar-1990-data.csv";
+    std::string snapshot = "data/test-snapshot.snap";
+
+    std::unique_ptr<Graph> loaded = loadFileMapped(file);
+    io::saveSnapshot(*loaded, snapshot, file);
+    std::unique_ptr<Graph> restored = io::loadSnapshot(snapshot, file);
+
+    REQUIRE(loaded->getAirports().size() == restored->getAirports().size());
+    REQUIRE(loaded->getFlights().size() == restored->getFlights().size());
+
+    for (Airport *a : loaded->getAirports()) {
+        REQUIRE(restored->getVertex(a->airport_id)->airport_code == a->airport_code);
+    }
+
+    for (Flight f : loaded->getFlights()) {
+        Flight other = restored->getEdge(f.flight_id);
+
+        REQUIRE(other.departure->airport_id == f.departure->airport_id);
+        REQUIRE(other.arrival->airport_id == f.arrival->airport_id);
+        REQUIRE(other.depart_time == f.depart_time);
+        REQUIRE(other.arrive_time == f.arrive_time);
+        REQUIRE(other.weekday == f.weekday);
+        REQUIRE(other.airline == f.airline);
+        REQUIRE(other.distance == f.distance);
+        REQUIRE(other.airtime == f.airtime);
+        REQUIRE(other.frequency == f.frequency);
+    }
+
+    REQUIRE_FALSE(restored->hasStopTable());
+
+    std::remove(snapshot.c_str());
+}
+
+TEST_CASE("Snapshots keep the stop table") {
+    std::string file = "data/mar-1990-data.csv";
+    std::string snapshot = "data/test-stops-snapshot.snap";
+
+    std::unique_ptr<Graph> loaded = loadFileMapped(file);
+    loaded->computeStopTable(2);
+    REQUIRE(loaded->hasStopTable());
+
+    io::saveSnapshot(*loaded, snapshot, file);
+    std::unique_ptr<Graph> restored = io::loadSnapshot(snapshot, file);
+
+    REQUIRE(restored->hasStopTable());
+    REQUIRE(restored->getStopTable() == loaded->getStopTable());
+
+    std::remove(snapshot.c_str());
+}
+
+TEST_CASE("Stale or missing snapshots are rejected") {
+    std::string file = "data/test-snapshot-source.csv";
+    std::string snapshot = "data/test-snapshot-source.csv.snap";
+
+    REQUIRE(io::snapshotPath(file) == snapshot);
+
+    std::ofstream(file) << "one version of the file";
+
+    Graph g;
+    io::saveSnapshot(g, snapshot, file);
+    io::loadSnapshot(snapshot, file);
+
+    REQUIRE_THROWS(io::loadSnapshot("data/no-such-snapshot.snap", file));
+
+    // a different size makes the snapshot stale
+    std::ofstream(file) << "another, longer version of the file";
+
+    try {
+        io::loadSnapshot(snapshot, file);
+        FAIL("Stale snapshot was loaded.");
+    } catch (int i) {
+        REQUIRE(i == -4);
+    }
+
+    std::remove(file.c_str());
+    std::remove(snapshot.c_str());
+}
+
+TEST_CASE("Snapshots with impossible counts are rejected") {
+    std::string file = "data/mar-1990-data.csv";
+    std::string snapshot = "data/test-corrupt-snapshot.snap";
+
+    std::unique_ptr<Graph> loaded = loadFileMapped(file);
+    io::saveSnapshot(*loaded, snapshot, file);
+
+    std::string bytes;
+    {
+        std::ifstream in(snapshot, std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    // rewrite a 64-bit count in the header (airport_count is at byte 32, flight_count at 40)
+    auto corrupt = [&](size_t offset, uint64_t add) {
+        std::string changed = bytes;
+        uint64_t count;
+        std::memcpy(&count, changed.data() + offset, sizeof(count));
+        count += add;
+        std::memcpy(&changed[offset], &count, sizeof(count));
+
+        std::ofstream(snapshot, std::ios::binary) << changed;
+
+        try {
+            io::loadSnapshot(snapshot, file);
+            FAIL("Corrupt snapshot was loaded.");
+        } catch (int i) {
+            REQUIRE(i == -4);
+        }
+    };
+
+    // 2^60 more airports of 16 bytes each wraps around to the same file size
+    corrupt(32, uint64_t(1) << 60);
+    corrupt(40, UINT64_MAX);
+    corrupt(40, 1);
+
+    // a stop table for no airports (the header is 64 bytes, stop_table_bytes is at byte 56)
+    Graph empty;
+    io::saveSnapshot(empty, snapshot, file);
+    {
+        std::ifstream in(snapshot, std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    REQUIRE(bytes.size() == 64);
+    bytes += '\0';
+    corrupt(56, 1);
+
+    std::remove(snapshot.c_str());
+}
+
 // TODO: Add adjacency tests, shortest path tests, and airport ranking tests
@@ -3,8 +3,13 @@
 #include "../utils.h"
 #include "../graph.h"
 
+#include <algorithm>
+#include <cmath>
 #include <vector>
 
+using data::Graph;
+using data::Airport;
+using data::Flight;
 
 /** This file should be used for testing the Markov method.
  * Compile using: make testmarkov
@@ -71,4 +76,279 @@ TEST_CASE("Power iteration") {
     REQUIRE(std::abs(product[0] - expected[0]) < 0.0001);
     REQUIRE(std::abs(product[1] - expected[1]) < 0.0001); 
     REQUIRE(std::abs(product[2] - expected[2]) < 0.0001);  
-}
\ No newline at end of file
+}
+// Sparse matrix testing
+TEST_CASE("Sparse matrices add duplicate entries") {
+    utils::SparseMatrix matrix = utils::sparseMatrix(3, 3, {{2, 0, 1}, {0, 1, 2}, {2, 0, 3}, {0, 0, 1}});
+
+    REQUIRE(matrix.row_offsets == std::vector<size_t>({0, 2, 2, 3}));
+    REQUIRE(matrix.columns == std::vector<size_t>({0, 1, 0}));
+    REQUIRE(matrix.values == std::vector<double>({1, 2, 4}));
+
+    REQUIRE_THROWS(utils::sparseMatrix(3, 3, {{3, 0, 1}}));
+}
+
+TEST_CASE("Sparse matrix vector product") {
+    utils::SparseMatrix matrix = utils::sparseMatrix(3, 3, {{0, 0, 1}, {0, 1, 2}, {0, 2, 3}, {1, 0, 4}, {1, 1, 5}, {1, 2, 6}, {2, 0, 7}, {2, 1, 8}, {2, 2, 9}});
+    std::vector<double> a = {1, 2, 3};
+    std::vector<double> product;
+
+    utils::matrixVectorProduct(matrix, a, product);
+    REQUIRE(product == std::vector<double>({14, 32, 50}));
+
+    std::vector<double> b = {1, 2, 3, 5};
+    REQUIRE_THROWS(utils::matrixVectorProduct(matrix, b, product));
+}
+
+TEST_CASE("Sparse power iteration stops once it converges") {
+    utils::SparseMatrix matrix = utils::sparseMatrix(3, 3, {{0, 0, 0.5}, {0, 1, 1.0/3}, {1, 0, 0.5}, {1, 1, 1.0/3}, {1, 2, 0.5}, {2, 1, 1.0/3}, {2, 2, 0.5}});
+    std::vector<double> a = {1, 0, 0};
+    double residual = 0;
+
+    size_t iterations = utils::powerIteration(matrix, a, 1e-12, 1000, residual);
+
+    std::vector<double> expected = {0.2857142857, 0.4285714286, 0.2857142857};
+
+    REQUIRE(iterations < 1000);
+    REQUIRE(residual < 1e-12);
+    REQUIRE(std::abs(a[0] - expected[0]) < 0.0001);
+    REQUIRE(std::abs(a[1] - expected[1]) < 0.0001);
+    REQUIRE(std::abs(a[2] - expected[2]) < 0.0001);
+}
+
+TEST_CASE("Power iteration gives the same result on several threads") {
+    // a ring where every node also links to a few others, large enough to be split between threads
+    size_t n = 5000;
+    std::vector<utils::MatrixEntry> entries;
+
+    for (size_t col = 0; col < n; col++) {
+        for (size_t k : {1, 7, 31, 127, 1000}) entries.push_back(utils::MatrixEntry{(col * k + 1) % n, col, 0.2});
+    }
+
+    utils::SparseMatrix matrix = utils::sparseMatrix(n, n, entries);
+
+    std::vector<double> single(n, 0), parallel(n, 0);
+    single[0] = parallel[0] = 1;
+    double single_residual = 0, parallel_residual = 0;
+
+    size_t single_iterations = utils::powerIteration(matrix, single, 1e-10, 1000, single_residual, 1);
+    size_t parallel_iterations = utils::powerIteration(matrix, parallel, 1e-10, 1000, parallel_residual, 4);
+
+    REQUIRE(parallel_iterations == single_iterations);
+    REQUIRE(std::abs(parallel_residual - single_residual) < 1e-12);
+
+    for (size_t i = 0; i < n; i++) REQUIRE(std::abs(parallel[i] - single[i]) < 1e-12);
+
+    // odd and even iteration counts leave the result in different buffers
+    std::vector<double> odd(n, 1.0 / n);
+    double residual = 0;
+    REQUIRE(utils::powerIteration(matrix, odd, 0, 3, residual, 4) == 3);
+    REQUIRE(odd.size() == n);
+
+    std::vector<double> wrong_size(n + 1, 0);
+    REQUIRE_THROWS(utils::powerIteration(matrix, wrong_size, 0, 3, residual, 4));
+}
+
+TEST_CASE("normalize makes a vector sum to 1") {
+    std::vector<double> a = {1, -2, 1};
+    std::vector<double> normalized = utils::normalize(a);
+
+    REQUIRE(normalized == std::vector<double>({0.25, -0.5, 0.25}));
+}
+
+TEST_CASE("PageRank handles dangling nodes and personalization") {
+    // 0 -> 1, 0 -> 2, 1 -> 0, and 2 has no way out
+    utils::SparseMatrix matrix = utils::sparseMatrix(3, 3, {{1, 0, 0.5}, {2, 0, 0.5}, {0, 1, 1}});
+    double damping = 0.85;
+    double residual = 0;
+
+    for (std::vector<double> personalization : {std::vector<double>({1, 1, 1}), std::vector<double>({0, 2, 0})}) {
+        std::vector<double> rank(3, 0);
+        utils::pageRank(matrix, rank, personalization, damping, 1e-14, 1000, residual);
+
+        // the definition, one step at a time: follow a flight, or jump (always jump from 2)
+        std::vector<double> expected = {1.0 / 3, 1.0 / 3, 1.0 / 3};
+        double total = personalization[0] + personalization[1] + personalization[2];
+
+        for (size_t iter = 0; iter < 1000; iter++) {
+            double jump = (1 - damping) + damping * expected[2];
+            std::vector<double> step(3);
+
+            for (size_t i = 0; i < 3; i++) step[i] = jump * personalization[i] / total;
+            step[1] += damping * 0.5 * expected[0];
+            step[2] += damping * 0.5 * expected[0];
+            step[0] += damping * expected[1];
+
+            expected = step;
+        }
+
+        REQUIRE(residual < 1e-14);
+        for (size_t i = 0; i < 3; i++) REQUIRE(std::abs(rank[i] - expected[i]) < 1e-10);
+    }
+
+    std::vector<double> rank(3, 0);
+    REQUIRE_THROWS(utils::pageRank(matrix, rank, {0, 0, 0}, damping, 1e-14, 1000, residual));
+    REQUIRE_THROWS(utils::pageRank(matrix, rank, {1, 1, 1}, 1.5, 1e-14, 1000, residual));
+}
+
+TEST_CASE("Personalized rankings warm start from the previous one") {
+    Airport *a = new Airport(), *b = new Airport(), *c = new Airport(), *d = new Airport();
+    a->airport_id = 1;
+    b->airport_id = 2;
+    c->airport_id = 3;
+    d->airport_id = 4;
+
+    Graph graph;
+    graph.createVertex(a);
+    graph.createVertex(b);
+    graph.createVertex(c);
+    graph.createVertex(d);
+
+    // b is the hub, and nothing leaves d
+    size_t routes[][2] = {{1, 2}, {2, 1}, {2, 3}, {3, 2}, {2, 4}, {1, 3}};
+    for (size_t i = 0; i < 6; i++) {
+        Flight f;
+        f.departure = graph.getVertex(routes[i][0]);
+        f.arrival = graph.getVertex(routes[i][1]);
+        f.frequency = data::DAILY;
+        f.airline = i < 3 ? "AA" : "UA";
+        f.flight_id = i;
+        graph.createEdge(f);
+    }
+
+    data::RankOptions options;
+    data::RankStats first, second;
+
+    std::vector<std::pair<Airport*, double>> ranking = graph.rankAirports(options, SIZE_MAX, &first);
+    REQUIRE(ranking.size() == 4);
+    REQUIRE(ranking[0].first == b);
+    REQUIRE_FALSE(first.warm_start);
+
+    graph.rankAirports(options, SIZE_MAX, &second);
+    REQUIRE(second.warm_start);
+    REQUIRE(second.iterations < first.iterations);
+    REQUIRE(second.iterations <= 2);
+
+    // relative to d, d comes first
+    options.personalization.push_back(std::pair<Airport*, double>(d, 1));
+    REQUIRE(graph.rankAirports(options)[0].first == d);
+
+    // AA only flies from a and b
+    std::vector<std::pair<Airport*, double>> hubs = graph.airlineHubs("AA");
+    REQUIRE(hubs.size() == 2);
+
+    Airport other;
+    other.airport_id = 5;
+    options.personalization.push_back(std::pair<Airport*, double>(&other, 1));
+    REQUIRE_THROWS(graph.rankAirports(options));
+}
+
+TEST_CASE("Rankings break ties by airport_id and can stop at the top k") {
+    Graph graph;
+    std::vector<Airport*> airports;
+
+    // a cycle of 5 airports, added in reverse, so every airport has exactly the same score
+    for (size_t id = 5; id >= 1; id--) {
+        airports.push_back(new Airport());
+        airports.back()->airport_id = id;
+        graph.createVertex(airports.back());
+    }
+
+    for (size_t i = 0; i < airports.size(); i++) {
+        Flight f;
+        f.departure = airports[i];
+        f.arrival = airports[(i + 1) % airports.size()];
+        f.frequency = data::WEEKLY;
+        f.flight_id = i;
+        graph.createEdge(f);
+    }
+
+    std::vector<std::pair<Airport*, double>> ranking = graph.rankAirports(data::RankOptions());
+    REQUIRE(ranking.size() == 5);
+
+    for (size_t i = 0; i < ranking.size(); i++) {
+        REQUIRE(ranking[i].first->airport_id == i + 1);
+        REQUIRE(ranking[i].second == ranking[0].second);
+    }
+
+    std::vector<std::pair<Airport*, double>> top = graph.rankAirports(data::RankOptions(), 2);
+    REQUIRE(top.size() == 2);
+    REQUIRE(top[0] == ranking[0]);
+    REQUIRE(top[1] == ranking[1]);
+
+    REQUIRE(graph.rankAirports(data::RankOptions(), 0).empty());
+    REQUIRE(graph.rankAirports(data::RankOptions(), 100).size() == 5);
+}
+
+TEST_CASE("Tracked rankings stay up to date as flights are added") {
+    Graph graph;
+    std::vector<Airport*> airports;
+
+    for (size_t id = 1; id <= 30; id++) {
+        airports.push_back(new Airport());
+        airports.back()->airport_id = id;
+        graph.createVertex(airports.back());
+    }
+
+    // airport 29 has no departures until the end
+    size_t flight_id = 0;
+    auto addFlight = [&](size_t from, size_t to, data::Frequency frequency) {
+        Flight f;
+        f.departure = airports[from];
+        f.arrival = airports[to];
+        f.frequency = frequency;
+        f.flight_id = flight_id++;
+        graph.createEdge(f);
+    };
+
+    for (size_t i = 0; i < 29; i++) {
+        addFlight(i, (i + 1) % 30, data::DAILY);
+        addFlight(i, (i * 7 + 3) % 30, data::WEEKLY);
+        addFlight(i, 0, data::MONTHLY);
+    }
+
+    graph.freeze();
+    REQUIRE_THROWS(graph.trackedRanking());
+
+    graph.trackRanking();
+    REQUIRE(graph.isTrackingRanking());
+
+    auto matches = [&graph]() {
+        data::RankStats stats;
+        std::vector<std::pair<Airport*, double>> tracked = graph.trackedRanking(SIZE_MAX, &stats);
+        std::vector<std::pair<Airport*, double>> full = graph.rankAirports(data::RankOptions());
+
+        REQUIRE(tracked.size() == full.size());
+        REQUIRE(stats.residual <= 1e-10);
+
+        for (size_t i = 0; i < full.size(); i++) {
+            auto found = std::find_if(tracked.begin(), tracked.end(),
+                                      [&](const std::pair<Airport*, double> &p) { return p.first == full[i].first; });
+            REQUIRE(found != tracked.end());
+            REQUIRE(std::abs(found->second - full[i].second) < 1e-8);
+        }
+
+        return stats.iterations;
+    };
+
+    size_t start = matches();
+
+    // a busier route, a new route and the first flight out of the dangling airport
+    addFlight(3, 4, data::DAILY);
+    addFlight(10, 20, data::DAILY);
+    addFlight(29, 5, data::WEEKLY);
+    REQUIRE(graph.isTrackingRanking());
+
+    size_t after = matches();
+    REQUIRE(after > start);
+
+    // a new airport starts the ranking over
+    Airport *extra = new Airport();
+    extra->airport_id = 31;
+    graph.createVertex(extra);
+    airports.push_back(extra);
+    addFlight(30, 0, data::DAILY);
+
+    matches();
+    REQUIRE(graph.trackedRanking(3).size() == 3);
+}
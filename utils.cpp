@@ -1,9 +1,16 @@
 #include "utils.h"
 
+#include <algorithm>
+#include <cctype>
+#include <climits>
 #include <cmath>
+#include <condition_variable>
 #include <iostream>
+#include <mutex>
+#include <stdexcept>
 #include <string>
 #include <sstream>
+#include <thread>
 #include <vector>
 
 std::vector<std::string> utils::split(const std::string &toSplit, char splitOn) {
@@ -24,6 +31,52 @@ std::vector<std::string> utils::split(const std::string &toSplit, char splitOn)
     return splitted;
 }
 
+size_t utils::split(std::string_view toSplit, char splitOn, std::string_view *fields, size_t maxFields) {
+    size_t count = 0;
+    size_t start = 0;
+
+    while (true) {
+        size_t end = toSplit.find(splitOn, start);
+        if (end == std::string_view::npos) end = toSplit.size();
+
+        if (count < maxFields) fields[count] = toSplit.substr(start, end - start);
+        count++;
+
+        if (end == toSplit.size()) break;
+        start = end + 1;
+    }
+
+    return count;
+}
+
+long utils::parseInt(std::string_view number) {
+    size_t i = 0;
+    while (i < number.size() && std::isspace((unsigned char) number[i])) i++;
+
+    bool negative = false;
+    if (i < number.size() && (number[i] == '-' || number[i] == '+')) {
+        negative = number[i] == '-';
+        i++;
+    }
+
+    if (i == number.size() || number[i] < '0' || number[i] > '9') throw std::invalid_argument("parseInt");
+
+    // std::stoi parses into an int, so anything outside its range is rejected the same way
+    long limit = negative ? -(long) INT_MIN : INT_MAX;
+
+    long value = 0;
+    for (; i < number.size() && number[i] >= '0' && number[i] <= '9'; i++) {
+        value = 10 * value + (number[i] - '0');
+        if (value > limit) throw std::out_of_range("parseInt");
+    }
+
+    return negative ? -value : value;
+}
+
+size_t utils::timeFromMidnight(std::string_view time) {
+    return 60 * parseInt(time.substr(1, 2)) + parseInt(time.substr(3, 2));
+}
+
 size_t utils::timeFromMidnight(std::string &time) {
     std::string hours = time.substr(1, 2);
     std::string mins = time.substr(3, 2);
@@ -63,13 +116,15 @@ std::vector<double> utils::matrixVectorProduct(std::vector<std::vector<double>>
 }
 
 std::vector<double> utils::normalize(std::vector<double> &vec) {
-    size_t sum = 0;
+    double sum = 0;
 
     for (double i : vec) {
         sum += std::abs(i);
     }
 
-    for (double i : vec) {
+    if (sum == 0) return vec;
+
+    for (double &i : vec) {
         i /= sum;
     }
 
@@ -83,4 +138,236 @@ std::vector<double> utils::powerIteration(std::vector<std::vector<double>> &matr
     }
 
     return vector;
-}
\ No newline at end of file
+}
+
+utils::SparseMatrix utils::sparseMatrix(size_t rows, size_t cols, std::vector<MatrixEntry> entries) {
+    std::sort(entries.begin(), entries.end(), [](const MatrixEntry &a, const MatrixEntry &b) {
+        return a.row < b.row || (a.row == b.row && a.col < b.col);
+    });
+
+    SparseMatrix matrix;
+    matrix.rows = rows;
+    matrix.cols = cols;
+    matrix.row_offsets.assign(rows + 1, 0);
+
+    for (size_t k = 0; k < entries.size(); k++) {
+        if (entries[k].row >= rows || entries[k].col >= cols) throw -1;
+
+        // add duplicates to the entry before them
+        if (k > 0 && entries[k].row == entries[k - 1].row && entries[k].col == entries[k - 1].col) {
+            matrix.values.back() += entries[k].value;
+            continue;
+        }
+
+        matrix.columns.push_back(entries[k].col);
+        matrix.values.push_back(entries[k].value);
+        matrix.row_offsets[entries[k].row + 1]++;
+    }
+
+    for (size_t i = 0; i < rows; i++) matrix.row_offsets[i + 1] += matrix.row_offsets[i];
+
+    return matrix;
+}
+
+void utils::matrixVectorProduct(const SparseMatrix &matrix, const std::vector<double> &vector, std::vector<double> &product) {
+    if (matrix.rows == 0 || matrix.cols != vector.size()) throw -1;
+
+    product.resize(matrix.rows);
+
+    for (size_t i = 0; i < matrix.rows; i++) {
+        double sum = 0;
+
+        for (size_t k = matrix.row_offsets[i]; k < matrix.row_offsets[i + 1]; k++) {
+            sum += matrix.values[k] * vector[matrix.columns[k]];
+        }
+
+        product[i] = sum;
+    }
+}
+
+namespace {
+    // Entries per thread below which power iteration does not split the matrix any further.
+    const size_t MIN_ENTRIES_PER_THREAD = 4096;
+
+    // Makes threads wait until all of them have arrived, then lets them all continue. Can be reused.
+    class Barrier {
+        public:
+            Barrier(size_t count): count(count) {}
+
+            void wait() {
+                std::unique_lock<std::mutex> lock(mutex);
+                size_t current = generation;
+
+                if (++arrived == count) {
+                    arrived = 0;
+                    generation++;
+                    all_arrived.notify_all();
+                } else {
+                    all_arrived.wait(lock, [&] { return generation != current; });
+                }
+            }
+
+        private:
+            std::mutex mutex;
+            std::condition_variable all_arrived;
+            size_t count;
+            size_t arrived = 0;
+            size_t generation = 0;
+    };
+
+    // Multiply rows first to last - 1 of the matrix with x into y. Returns the 1-norm of those rows of y.
+    double multiplyRows(const utils::SparseMatrix &matrix, const double *x, double *y, size_t first, size_t last) {
+        const size_t *columns = matrix.columns.data();
+        const double *values = matrix.values.data();
+        double norm = 0;
+
+        for (size_t i = first; i < last; i++) {
+            size_t k = matrix.row_offsets[i];
+            size_t end = matrix.row_offsets[i + 1];
+
+            // four independent sums, so the loads from x do not wait on each other
+            double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+
+            for (; k + 4 <= end; k += 4) {
+                s0 += values[k] * x[columns[k]];
+                s1 += values[k + 1] * x[columns[k + 1]];
+                s2 += values[k + 2] * x[columns[k + 2]];
+                s3 += values[k + 3] * x[columns[k + 3]];
+            }
+
+            for (; k < end; k++) s0 += values[k] * x[columns[k]];
+
+            y[i] = (s0 + s1) + (s2 + s3);
+            norm += std::abs(y[i]);
+        }
+
+        return norm;
+    }
+
+    // Scale rows first to last - 1 of y. Returns the 1-norm of the change from x in those rows.
+    double scaleRows(double *y, const double *x, double scale, size_t first, size_t last) {
+        double change = 0;
+
+        for (size_t i = first; i < last; i++) {
+            y[i] *= scale;
+            change += std::abs(y[i] - x[i]);
+        }
+
+        return change;
+    }
+
+    /** The loop shared by power iteration and PageRank. Each iteration multiplies x into y one row block per thread,
+     * then calls update(y, x, norm of y, first row, last row) on each block. update returns the change in its rows.
+     * The iteration stops when the change is below tolerance, or when y is all zeros if stopWhenEmpty is set.
+     */
+    template <typename Update>
+    size_t iterate(const utils::SparseMatrix &matrix, std::vector<double> &vector, double tolerance, size_t maxIter, double &residual,
+                   size_t threads, bool stopWhenEmpty, Update update) {
+        if (matrix.rows == 0 || matrix.rows != matrix.cols || matrix.cols != vector.size()) throw -1;
+
+        threads = std::max<size_t>(1, std::min({threads, matrix.rows, matrix.values.size() / MIN_ENTRIES_PER_THREAD}));
+
+        // row blocks with about the same number of entries
+        std::vector<size_t> bounds(threads + 1, matrix.rows);
+        bounds[0] = 0;
+
+        for (size_t t = 1; t < threads; t++) {
+            size_t target = matrix.values.size() * t / threads;
+            bounds[t] = std::lower_bound(matrix.row_offsets.begin(), matrix.row_offsets.end() - 1, target) - matrix.row_offsets.begin();
+            bounds[t] = std::max(bounds[t], bounds[t - 1]);
+        }
+
+        std::vector<double> next(matrix.rows);
+        std::vector<double> norms(threads);
+        std::vector<double> changes(threads);
+        Barrier barrier(threads);
+
+        size_t iterations = maxIter;
+        residual = 0;
+
+        // Every thread adds up norms and changes in the same order, so they all stop after the same iteration.
+        auto work = [&](size_t t) {
+            double *x = vector.data();
+            double *y = next.data();
+
+            for (size_t iter = 0; iter < maxIter; iter++) {
+                norms[t] = multiplyRows(matrix, x, y, bounds[t], bounds[t + 1]);
+                barrier.wait();
+
+                double sum = 0;
+                for (double n : norms) sum += n;
+
+                changes[t] = update(y, x, sum, bounds[t], bounds[t + 1]);
+                barrier.wait();
+
+                double change = 0;
+                for (double c : changes) change += c;
+
+                std::swap(x, y);
+
+                if ((stopWhenEmpty && sum == 0) || change < tolerance || iter + 1 == maxIter) {
+                    if (t == 0) {
+                        iterations = iter + 1;
+                        residual = change;
+                    }
+
+                    return;
+                }
+            }
+        };
+
+        std::vector<std::thread> workers;
+        for (size_t t = 1; t < threads; t++) workers.emplace_back(work, t);
+        work(0);
+
+        for (std::thread &worker : workers) worker.join();
+
+        // the result is in next after an odd number of iterations
+        if (iterations % 2 == 1) vector.swap(next);
+
+        return iterations;
+    }
+}
+
+size_t utils::powerIteration(const SparseMatrix &matrix, std::vector<double> &vector, double tolerance, size_t maxIter, double &residual,
+                             size_t threads) {
+    // if everything flowed into rows with no entries, there is nothing left to normalize or iterate
+    return iterate(matrix, vector, tolerance, maxIter, residual, threads, true,
+                   [](double *y, const double *x, double sum, size_t first, size_t last) {
+                       return scaleRows(y, x, sum == 0 ? 1 : 1 / sum, first, last);
+                   });
+}
+
+size_t utils::pageRank(const SparseMatrix &matrix, std::vector<double> &vector, const std::vector<double> &personalization, double damping,
+                       double tolerance, size_t maxIter, double &residual, size_t threads) {
+    if (personalization.size() != vector.size() || damping < 0 || damping > 1) throw -1;
+
+    std::vector<double> teleport = personalization;
+    normalize(teleport);
+
+    double total = 0;
+    for (double x : teleport) total += x;
+    if (total == 0) throw -1;
+
+    // start from the personalization if the starting vector is empty
+    double sum = 0;
+    for (double x : vector) sum += std::abs(x);
+
+    if (sum == 0) vector = teleport;
+    else normalize(vector);
+
+    // The columns of the matrix sum to 1, or to 0 for a dangling node, so whatever mass is missing from Ax
+    // (jumps, and everything sitting on a dangling node) is sent back out along the personalization.
+    return iterate(matrix, vector, tolerance, maxIter, residual, threads, false,
+                   [&teleport, damping](double *y, const double *x, double sum, size_t first, size_t last) {
+                       double missing = 1 - damping * sum;
+                       double change = 0;
+
+                       for (size_t i = first; i < last; i++) {
+                           y[i] = damping * y[i] + missing * teleport[i];
+                           change += std::abs(y[i] - x[i]);
+                       }
+
+                       return change;
+                   });
+}
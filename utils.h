@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace utils
@@ -12,9 +13,27 @@ namespace utils
      */
     std::vector<std::string> split(const std::string &toSplit, char splitOn);
 
+    /** Split a string along a given character without copying it.
+     * Only the first maxFields fields are stored, the rest are counted but ignored.
+     * @param toSplit The string to split
+     * @param splitOn The character to split on
+     * @param fields Output array of at least maxFields views into toSplit
+     * @param maxFields The size of fields
+     * @return the number of fields in the line (may be more than maxFields)
+     */
+    size_t split(std::string_view toSplit, char splitOn, std::string_view *fields, size_t maxFields);
+
+    /** Parse a base 10 integer the same way std::stoi does, without creating a string.
+     * Leading whitespace is skipped and parsing stops at the first non-digit.
+     * @throws std::invalid_argument if no digits could be read
+     * @throws std::out_of_range if the number does not fit in an int
+     */
+    long parseInt(std::string_view number);
+
     /** Calculate the time in minutes from midnight given a string of the form 0015 (0 hours, 15 mins)
      */
     size_t timeFromMidnight(std::string &time);
+    size_t timeFromMidnight(std::string_view time);
 
     /** Return the time as an hh:mm string 
      * @param minsFromMidnight time in minutes from midnight
@@ -45,4 +64,67 @@ namespace utils
      */
     std::vector<double> powerIteration(std::vector<std::vector<double>> &matrix, std::vector<double> &vector, size_t iter);
 
+    /** A matrix in compressed sparse row (CSR) form. The entries of row i are values[row_offsets[i]]
+     * to values[row_offsets[i + 1] - 1], and columns holds the column of each one.
+     */
+    struct SparseMatrix {
+        size_t rows = 0;
+        size_t cols = 0;
+
+        std::vector<size_t> row_offsets;
+        std::vector<size_t> columns;
+        std::vector<double> values;
+    };
+
+    /** A single entry of a sparse matrix, used to build one.
+     */
+    struct MatrixEntry {
+        size_t row;
+        size_t col;
+        double value;
+    };
+
+    /** Build a sparse matrix from its entries. Entries in the same position are added together.
+     * @param rows, cols The size of the matrix
+     * @param entries The nonzero entries, in any order
+     * @throws -1 if an entry is outside the matrix.
+     */
+    SparseMatrix sparseMatrix(size_t rows, size_t cols, std::vector<MatrixEntry> entries);
+
+    /** Multiply a sparse matrix and a vector without allocating a new vector.
+     * @param product Set to Ax. Must not be the same vector as vector.
+     * @throws -1 if the matrix and vector cannot be multiplied.
+     */
+    void matrixVectorProduct(const SparseMatrix &matrix, const std::vector<double> &vector, std::vector<double> &product);
+
+    /** Perform power iteration on a square sparse matrix until it converges.
+     * The vector is normalized with the 1-norm after every iteration.
+     * The rows are split into blocks with about the same number of entries, and each block is handled by one thread
+     * for the whole run. Small matrices are not split (each thread gets at least a few thousand entries).
+     * Two buffers are swapped between iterations, so nothing is allocated inside the loop.
+     * @param vector The starting vector. Replaced by the result.
+     * @param tolerance Stop once the 1-norm of the change in one iteration is below this.
+     * @param maxIter Stop after this many iterations even if the vector has not converged.
+     * @param residual Set to the 1-norm of the change in the last iteration.
+     * @param threads The most threads to use (the calling thread is one of them).
+     * @throws -1 if the matrix is not square or the matrix and vector cannot be multiplied.
+     * @return the number of iterations run.
+     */
+    size_t powerIteration(const SparseMatrix &matrix, std::vector<double> &vector, double tolerance, size_t maxIter, double &residual,
+                          size_t threads = 1);
+
+    /** Compute a damped, personalized PageRank with a column-stochastic sparse matrix, using the same threads as powerIteration.
+     * Each iteration follows the matrix with probability damping, and otherwise jumps to a node picked from personalization.
+     * Dangling nodes (columns with no entries) always jump.
+     * @param vector The starting vector, for example the result of an earlier call (a warm start). Replaced by the result.
+     *        If it is all zeros, the personalization is used instead.
+     * @param personalization Where jumps land, in proportion to each entry. Does not need to be normalized.
+     * @param damping The probability of following the matrix, between 0 and 1 (usually 0.85).
+     * @param tolerance, maxIter, residual, threads The same as for powerIteration.
+     * @throws -1 if the sizes do not match or damping is not between 0 and 1.
+     * @return the number of iterations run.
+     */
+    size_t pageRank(const SparseMatrix &matrix, std::vector<double> &vector, const std::vector<double> &personalization, double damping,
+                    double tolerance, size_t maxIter, double &residual, size_t threads = 1);
+
 } // namespace utils